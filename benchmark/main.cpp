@@ -0,0 +1,290 @@
+/********************************************************************************
+ *   Copyright (C) 2018 by NetResults S.r.l. ( http://www.netresults.it )       *
+ *   Author(s):                                                                 *
+ *              Francesco Lamonica  <f.lamonica@netresults.it>                  *
+ ********************************************************************************/
+
+/*
+ * Throughput benchmark for NrFileCompressor.
+ *
+ * Measures MB/s and peak RSS for compressGzipFile(), compressZipFile() and
+ * uncompressZipFile() across three synthetic corpora (incompressible,
+ * text-like, zero-filled), a range of file sizes and compression levels
+ * 0-9, and writes the results as JSON for the perf dashboard.
+ *
+ * Usage:
+ *   benchmark_compress [--max-size <bytes>] [--quick] [--out <file.json>]
+ *
+ * --max-size caps the largest corpus (default 64 MB so a full run stays
+ * in the minutes range; pass up to 4 GB when chasing large-file issues -
+ * corpora are streamed to disk in chunks, never held in memory whole).
+ * --quick restricts the level sweep to 0/1/6/9.
+ */
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+
+#include <iostream>
+
+#include <NrFileCompressor.h>
+
+
+/* reads VmHWM (peak resident set size, in kB) from /proc; 0 where unsupported */
+static qint64 peakRssKb()
+{
+#ifdef Q_OS_LINUX
+    QFile f("/proc/self/status");
+    if (f.open(QIODevice::ReadOnly)) {
+        while (!f.atEnd()) {
+            QByteArray line = f.readLine();
+            if (line.startsWith("VmHWM:")) {
+                return line.mid(6).trimmed().split(' ').first().toLongLong();
+            }
+        }
+    }
+#endif
+    return 0;
+}
+
+
+//the generators stream the corpus to disk in chunks of this size, so a
+//4 GB corpus never has to exist as one QByteArray (Qt caps those at 2 GB)
+static const qint64 CORPUS_CHUNK = 4 * 1024 * 1024;
+
+
+/* xorshift32: cheap deterministic noise, incompressible for deflate's purposes */
+static bool makeIncompressible(QFile &f, qint64 size)
+{
+    QByteArray buf;
+    buf.resize((int)qMin(size, CORPUS_CHUNK));
+    quint32 state = 0x12345678u;
+    for (qint64 written = 0; written < size; ) {
+        qint64 n = qMin(size - written, (qint64)buf.size());
+        for (qint64 i = 0; i < n; ++i) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            buf[(int)i] = (char)(state & 0xFF);
+        }
+        if (f.write(buf.constData(), n) != n) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+
+/* repeats a small vocabulary with a varying counter: compresses like real logs */
+static bool makeTextLike(QFile &f, qint64 size)
+{
+    static const char *words[] = {
+        "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+        "INFO", "WARNING", "connection", "established", "timeout", "retry"
+    };
+    const int nwords = (int)(sizeof(words) / sizeof(words[0]));
+
+    QByteArray buf;
+    buf.reserve((int)CORPUS_CHUNK + 64);
+    quint32 n = 0;
+    for (qint64 written = 0; written < size; ) {
+        buf.clear();
+        const qint64 want = qMin(size - written, CORPUS_CHUNK);
+        while (buf.size() < want) {
+            buf.append(words[n % nwords]);
+            buf.append(' ');
+            if ((n % 11) == 0) {
+                buf.append(QByteArray::number(n));
+                buf.append('\n');
+            }
+            ++n;
+        }
+        buf.truncate((int)want);
+        if (f.write(buf) != want) {
+            return false;
+        }
+        written += want;
+    }
+    return true;
+}
+
+
+static bool makeZeroFilled(QFile &f, qint64 size)
+{
+    QByteArray buf((int)qMin(size, CORPUS_CHUNK), '\0');
+    for (qint64 written = 0; written < size; ) {
+        qint64 n = qMin(size - written, (qint64)buf.size());
+        if (f.write(buf.constData(), n) != n) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+
+struct BenchResult {
+    QString benchmark;
+    QString corpus;
+    qint64 size;
+    int level;
+    double millis;
+    double mbPerSec;
+    qint64 rssKb;
+};
+
+
+static void report(QList<BenchResult> &results, const QString &benchmark, const QString &corpus,
+                   qint64 size, int level, qint64 nsecs)
+{
+    BenchResult r;
+    r.benchmark = benchmark;
+    r.corpus = corpus;
+    r.size = size;
+    r.level = level;
+    r.millis = nsecs / 1e6;
+    r.mbPerSec = (nsecs > 0) ? (size / (1024.0 * 1024.0)) / (nsecs / 1e9) : 0.0;
+    r.rssKb = peakRssKb();
+    results.append(r);
+
+    std::cout << benchmark.toStdString() << "/" << corpus.toStdString()
+              << "/" << size << "/level" << level
+              << "  " << r.millis << " ms"
+              << "  " << r.mbPerSec << " MB/s"
+              << "  peakRSS " << r.rssKb << " kB" << std::endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    qint64 maxSize = 64LL * 1024 * 1024;
+    bool quick = false;
+    QString outFile = "benchmark_results.json";
+
+    QStringList args = a.arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        if (args[i] == "--max-size" && i + 1 < args.size()) {
+            maxSize = args[++i].toLongLong();
+        } else if (args[i] == "--quick") {
+            quick = true;
+        } else if (args[i] == "--out" && i + 1 < args.size()) {
+            outFile = args[++i];
+        } else {
+            std::cerr << "Usage: benchmark_compress [--max-size <bytes>] [--quick] [--out <file.json>]" << std::endl;
+            return 1;
+        }
+    }
+
+    QTemporaryDir workDir;
+    if (!workDir.isValid()) {
+        std::cerr << "Cannot create working directory" << std::endl;
+        return 1;
+    }
+
+    QList<int> levels;
+    if (quick) {
+        levels << 0 << 1 << 6 << 9;
+    } else {
+        for (int l = 0; l <= 9; ++l)
+            levels << l;
+    }
+
+    QList<qint64> sizes;
+    for (qint64 s = 4 * 1024; s <= maxSize; s *= 16)
+        sizes << s;
+
+    struct { const char *name; bool (*make)(QFile &, qint64); } corpora[] = {
+        { "incompressible", makeIncompressible },
+        { "text",           makeTextLike },
+        { "zeros",          makeZeroFilled },
+    };
+
+    QList<BenchResult> results;
+
+    for (size_t c = 0; c < sizeof(corpora) / sizeof(corpora[0]); ++c) {
+        for (int si = 0; si < sizes.size(); ++si) {
+            const qint64 size = sizes.at(si);
+            const QString corpus = corpora[c].name;
+            const QString srcName = QString("%1_%2.bin").arg(corpus).arg(size);
+            const QString srcPath = workDir.path() + "/" + srcName;
+
+            {
+                QFile f(srcPath);
+                if (!f.open(QIODevice::WriteOnly) || !corpora[c].make(f, size)) {
+                    std::cerr << "Cannot write corpus file " << srcPath.toStdString() << std::endl;
+                    return 1;
+                }
+            }
+
+            for (int li = 0; li < levels.size(); ++li) {
+                const int level = levels.at(li);
+                QElapsedTimer timer;
+
+                timer.start();
+                int res = NrFileCompressor::compressGzipFile(srcName, workDir.path(), workDir.path(), level);
+                if (res != 0) {
+                    std::cerr << "compressGzipFile failed: " << res << std::endl;
+                    return 1;
+                }
+                report(results, "compressGzipFile", corpus, size, level, timer.nsecsElapsed());
+                QFile::remove(srcPath + ".gz");
+
+                timer.start();
+                res = NrFileCompressor::compressZipFile(srcName, workDir.path(), workDir.path(), level);
+                if (res != 0) {
+                    std::cerr << "compressZipFile failed: " << res << std::endl;
+                    return 1;
+                }
+                report(results, "compressZipFile", corpus, size, level, timer.nsecsElapsed());
+
+                const QString zipPath = srcPath + ".zip";
+                QDir(workDir.path()).mkdir("extracted");
+
+                timer.start();
+                res = NrFileCompressor::uncompressZipFile(zipPath, workDir.path() + "/extracted");
+                if (res != 0) {
+                    std::cerr << "uncompressZipFile failed: " << res << std::endl;
+                    return 1;
+                }
+                report(results, "uncompressZipFile", corpus, size, level, timer.nsecsElapsed());
+
+                QFile::remove(zipPath);
+                QFile::remove(workDir.path() + "/extracted/" + srcName);
+            }
+
+            QFile::remove(srcPath);
+        }
+    }
+
+    QJsonArray jres;
+    for (int i = 0; i < results.size(); ++i) {
+        const BenchResult &r = results.at(i);
+        QJsonObject o;
+        o["benchmark"] = r.benchmark;
+        o["corpus"] = r.corpus;
+        o["size"] = r.size;
+        o["level"] = r.level;
+        o["ms"] = r.millis;
+        o["mb_per_s"] = r.mbPerSec;
+        o["peak_rss_kb"] = r.rssKb;
+        jres.append(o);
+    }
+
+    QFile out(outFile);
+    if (!out.open(QIODevice::WriteOnly)) {
+        std::cerr << "Cannot write results to " << outFile.toStdString() << std::endl;
+        return 1;
+    }
+    out.write(QJsonDocument(jres).toJson());
+
+    std::cout << results.size() << " results written to " << outFile.toStdString() << std::endl;
+    return 0;
+}
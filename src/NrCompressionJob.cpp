@@ -0,0 +1,144 @@
+/********************************************************************************
+ *   Copyright (C) 2018 by NetResults S.r.l. ( http://www.netresults.it )       *
+ *   Author(s):                                                                 *
+ *              Francesco Lamonica  <f.lamonica@netresults.it>                  *
+ ********************************************************************************/
+
+#include "NrCompressionJob.h"
+
+#include <QRunnable>
+#include <QThreadPool>
+
+
+BEGIN_NRFILECOMPRESSOR_NAMESPACE
+
+/*
+ * Thin QRunnable shim that runs the job body on the global thread pool.
+ * The job object itself stays owned by the caller.
+ */
+class NrCompressionJobRunnable : public QRunnable
+{
+public:
+    explicit NrCompressionJobRunnable(NrCompressionJob *i_job)
+        : m_job(i_job)
+    {
+        setAutoDelete(true);
+    }
+
+    void run()
+    {
+        m_job->execute();
+    }
+
+private:
+    NrCompressionJob *m_job;
+};
+
+
+/*!
+ * \brief NrCompressionJob::NrCompressionJob creates a job; nothing runs until start() is called
+ * \param filename the filename (without path) of the file to be compressed
+ * \param srcpath the path where the file to be compressed is located
+ * \param dstpath the path where the compressed file should be created (it must exists and be writable)
+ * \param algo the type of compression to be used, either GZIP or ZIP
+ * \param level the compression level (0=none(faster) .. 9=max (slower))
+ * \param parent the usual QObject parent
+ */
+NrCompressionJob::NrCompressionJob(const QString &filename, const QString &srcpath, const QString &dstpath,
+                                   NrFileCompressor::compressedFileFormatEnum algo, int level, QObject *parent)
+    : QObject(parent)
+    , m_filename(filename)
+    , m_srcpath(srcpath)
+    , m_dstpath(dstpath)
+    , m_algo(algo)
+    , m_level(level)
+    , m_cancelRequested(false)
+    , m_running(false)
+    , m_finished(false)
+    , m_result(0)
+{
+    /* empty ctor */
+}
+
+
+/*!
+ * \brief NrCompressionJob::start schedules the job on the global thread pool and returns immediately
+ * \note calling start() on a job that is already running or already finished does nothing
+ */
+void NrCompressionJob::start()
+{
+    bool expected = false;
+    if (m_finished.load() || !m_running.compare_exchange_strong(expected, true)) {
+        return;
+    }
+
+    QThreadPool::globalInstance()->start(new NrCompressionJobRunnable(this));
+}
+
+
+/*!
+ * \brief NrCompressionJob::cancel requests the running job to abort
+ *
+ * Cancellation is checked between input chunks on the gzip path, so the job
+ * stops within one chunk worth of work; finished() is then emitted with
+ * NrFileCompressor::E_OPERATION_CANCELED. A partially written destination
+ * file may be left behind and it is up to the caller to remove it.
+ */
+void NrCompressionJob::cancel()
+{
+    m_cancelRequested.store(true);
+}
+
+
+bool NrCompressionJob::isRunning() const
+{
+    return m_running.load();
+}
+
+
+bool NrCompressionJob::isFinished() const
+{
+    return m_finished.load();
+}
+
+
+/*!
+ * \brief NrCompressionJob::result
+ * \return the job return code, only meaningful after finished() has been emitted
+ */
+int NrCompressionJob::result() const
+{
+    return m_result.load();
+}
+
+
+/* the job body, executed on a pool thread */
+void NrCompressionJob::execute()
+{
+    int res;
+
+    if (m_algo == NrFileCompressor::GZIP_ARCHIVE) {
+        NrCompressionJob *self = this;
+        res = NrFileCompressor::compressGzipFileHooked(m_filename, m_srcpath, m_dstpath, m_level,
+                    [self](qint64 processed, qint64 total) { emit self->progress(processed, total); },
+                    &m_cancelRequested);
+    } else {
+        //every other format goes through the synchronous dispatch, so the
+        //job agrees with fileCompress() on registered backends, the gated
+        //builds and E_NO_BACKEND; these paths run as single calls, so only
+        //begin/end progress is reported
+        if (m_cancelRequested.load()) {
+            res = NrFileCompressor::E_OPERATION_CANCELED;
+        } else {
+            res = NrFileCompressor::fileCompress(m_filename, m_srcpath, m_dstpath, m_algo, m_level);
+        }
+    }
+
+    m_result.store(res);
+    m_running.store(false);
+    m_finished.store(true);
+
+    emit finished(res);
+}
+
+END_NRFILECOMPRESSOR_NAMESPACE
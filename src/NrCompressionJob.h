@@ -0,0 +1,70 @@
+/********************************************************************************
+ *   Copyright (C) 2018 by NetResults S.r.l. ( http://www.netresults.it )       *
+ *   Author(s):                                                                 *
+ *              Francesco Lamonica  <f.lamonica@netresults.it>                  *
+ ********************************************************************************/
+
+#ifndef NRCOMPRESSIONJOB_H
+#define NRCOMPRESSIONJOB_H
+
+#include <QObject>
+
+#include <atomic>
+
+#include "NrFileCompressor.h"
+
+
+BEGIN_NRFILECOMPRESSOR_NAMESPACE
+
+/*!
+ * \brief The NrCompressionJob class wraps one compression (or zip extraction)
+ *        task into an asynchronous, non-blocking job.
+ *
+ * The job runs on the global QThreadPool, so the caller thread (and its event
+ * loop) is never blocked: create the job, connect to its signals, call start()
+ * and wait for finished(). A running job can be aborted with cancel(); in that
+ * case finished() is emitted with NrFileCompressor::E_OPERATION_CANCELED.
+ *
+ * Signals are emitted from the worker thread and are delivered through the
+ * usual queued connections, so slots run in the receiver's thread.
+ */
+class NrCompressionJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit NrCompressionJob(const QString &filename, const QString &srcpath, const QString &dstpath,
+                              NrFileCompressor::compressedFileFormatEnum algo, int level = 6, QObject *parent = nullptr);
+
+    void start();
+    void cancel();
+
+    bool isRunning() const;
+    bool isFinished() const;
+    int result() const;
+
+signals:
+    /*! emitted while the job runs with the processed and total input bytes */
+    void progress(qint64 processed, qint64 total);
+    /*! emitted once when the job ends, with the same codes returned by the blocking API */
+    void finished(int result);
+
+private:
+    void execute();
+    friend class NrCompressionJobRunnable;
+
+    QString m_filename;
+    QString m_srcpath;
+    QString m_dstpath;
+    NrFileCompressor::compressedFileFormatEnum m_algo;
+    int m_level;
+
+    std::atomic<bool> m_cancelRequested;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_finished;
+    std::atomic<int> m_result;
+};
+
+END_NRFILECOMPRESSOR_NAMESPACE
+
+#endif // NRCOMPRESSIONJOB_H
@@ -7,12 +7,33 @@
 #include "NrFileCompressor.h"
 #include "miniz.h"
 
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
 #include <QDateTime>
 #include <QDir>
+#include <QDirIterator>
+#include <QHash>
+#include <QIODevice>
+#include <QRegExp>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
 
 #include <iostream>
+#include <memory>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+ #include <cerrno>
+ #include <cstdlib>
+ #include <fcntl.h>
+ #include <sched.h>
+ #include <unistd.h>
+#endif
 
 #if (_MSC_VER == 1900) //vs 2015
     #include <memory>
@@ -41,12 +62,49 @@
 BEGIN_NRFILECOMPRESSOR_NAMESPACE
 
 
+/* registered pluggable engines, keyed by compressedFileFormatEnum */
+static QHash<int, NrCompressionBackend *> s_backends;
+
+
+NrCompressionBackend::~NrCompressionBackend()
+{
+    /* empty dtor */
+}
+
+
 NrFileCompressor::NrFileCompressor()
 {
     /* empty ctor */
 }
 
 
+/*!
+ * \brief NrFileCompressor::registerBackend plugs a compression engine in behind fileCompress()
+ * \param algo the format value the backend serves (e.g. ZSTD_ARCHIVE); a registered backend overrides the built-in codec for that value
+ * \param backend the engine, owned by the caller and never deleted by this class; pass nullptr to unregister
+ * \warning register backends at startup, before any compression runs: the registry itself is not guarded against concurrent writes
+ */
+void NrFileCompressor::registerBackend(compressedFileFormatEnum algo, NrCompressionBackend *backend)
+{
+    if (backend) {
+        s_backends.insert(algo, backend);
+    } else {
+        s_backends.remove(algo);
+    }
+}
+
+
+/*!
+ * \brief NrFileCompressor::backend
+ * \param algo the format value to look up
+ * \return the backend registered for \a algo, or nullptr when the built-in codec (or none) serves it
+ */
+NrCompressionBackend *NrFileCompressor::backend(compressedFileFormatEnum algo)
+{
+    return s_backends.value(algo, nullptr);
+}
+
+
 /*!
  * \brief NrFileCompressor::fileCompress the basic function to be called to compress a file (zip file will be created in current working dir)
  * \param i_fileName the filename (without path) of the file to be compressed
@@ -71,10 +129,22 @@ int NrFileCompressor::fileCompress(QString const& i_fileName, const QString &i_s
  */
 int NrFileCompressor::fileCompress(QString const& i_fileName, const QString &i_srcpath, const QString &i_dstpath, NrFileCompressor::compressedFileFormatEnum i_algo, int i_lev)
 {
-    if (i_algo == NrFileCompressor::GZIP_ARCHIVE) {
-        return compressGzipFile(i_fileName, i_srcpath, i_dstpath, i_lev);
-    } else {
-        return compressZipFile(i_fileName, i_srcpath, i_dstpath, i_lev);
+    NrCompressionBackend *engine = backend(i_algo);
+    if (engine) {
+        return engine->compressFile(i_fileName, i_srcpath, i_dstpath, i_lev);
+    }
+
+    switch (i_algo) {
+        case NrFileCompressor::GZIP_ARCHIVE:
+            return compressGzipFile(i_fileName, i_srcpath, i_dstpath, i_lev);
+#if !defined(NRFILECOMPRESSOR_NO_ZIP) && !defined(NRFILECOMPRESSOR_NO_ZIP_WRITER)
+        case NrFileCompressor::ZIP_ARCHIVE:
+        case NrFileCompressor::NO_COMPRESSION: //historic behaviour: anything but gzip went down the zip path
+            return compressZipFile(i_fileName, i_srcpath, i_dstpath, i_lev);
+#endif
+        default:
+            std::cerr << "No compression backend registered for format " << i_algo << std::endl;
+            return NrFileCompressor::E_NO_BACKEND;
     }
 }
 
@@ -109,6 +179,11 @@ QString calculateFilenameWithPath(const QString &i_dstPath, const QString & file
 QString
 NrFileCompressor::getCompressedFilename(const QString &i_fileName, NrFileCompressor::compressedFileFormatEnum i_algo)
 {
+    NrCompressionBackend *engine = NrFileCompressor::backend(i_algo);
+    if (engine) {
+        return i_fileName + engine->fileExtension();
+    }
+
     switch(i_algo) {
         case NrFileCompressor::GZIP_ARCHIVE:
             return i_fileName + GZIP_EXT;
@@ -119,10 +194,384 @@ NrFileCompressor::getCompressedFilename(const QString &i_fileName, NrFileCompres
     }
 }
 
+/* out-of-class definition so the constant can be odr-used */
+const int NrFileCompressor::ADAPTIVE_COMPRESSION_LEVEL;
+
+
+//how much of the input the adaptive governor trial-compresses
+static const qint64 ADAPTIVE_SAMPLE_SIZE = (128 * 1024);
+
+/* trial-compresses (at most ADAPTIVE_SAMPLE_SIZE bytes of) an in-memory
+   sample at the fastest setting and maps the observed ratio to a level:
+   already-compressed data (media, archives) gets storing or level 1 so we
+   stop burning CPU for sub-percent gains, everything else keeps the regular
+   default */
+static int resolveAdaptiveLevelFromSample(const char *i_data, qint64 i_size)
+{
+    if (i_size > ADAPTIVE_SAMPLE_SIZE) {
+        i_size = ADAPTIVE_SAMPLE_SIZE;
+    }
+
+    //too little data for the estimate (or the savings) to matter
+    if (i_size < 4096) {
+        return MZ_DEFAULT_LEVEL;
+    }
+
+    size_t outLen = 0;
+    mz_uint flags = tdefl_create_comp_flags_from_zip_params(1, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+    void *pTrial = tdefl_compress_mem_to_heap(i_data, (size_t)i_size, &outLen, (int)flags);
+    if (!pTrial) {
+        return MZ_DEFAULT_LEVEL;
+    }
+    mz_free(pTrial);
+
+    double ratio = (double)outLen / (double)i_size;
+    if (ratio >= 0.99) {
+        return 0; //incompressible: just store
+    }
+    if (ratio >= 0.95) {
+        return 1; //barely compressible: cheapest real level
+    }
+    return MZ_DEFAULT_LEVEL;
+}
+
+
+/* device flavour of the governor: samples the head without moving the
+   device position (peek) */
+static int resolveAdaptiveLevel(QIODevice *in)
+{
+    QByteArray sample = in->peek(ADAPTIVE_SAMPLE_SIZE);
+    return resolveAdaptiveLevelFromSample(sample.constData(), sample.size());
+}
+
+
+/*******************
+ *    BATCH PART   *
+ * *****************/
+
+//opt-in NUMA placement of the worker pools (see setNumaAwareWorkers())
+static std::atomic<bool> s_numaAwareWorkers(false);
+
+
+#ifdef Q_OS_LINUX
+/* one cpu_set_t per NUMA node, parsed once from sysfs; empty on single-node
+   machines or when the topology files are unreadable */
+static std::vector<cpu_set_t> parseNumaTopology()
+{
+    std::vector<cpu_set_t> nodes;
+
+    QDir nodeDir("/sys/devices/system/node");
+    QStringList entries = nodeDir.entryList(QStringList() << "node*", QDir::Dirs, QDir::Name);
+    for (int i = 0; i < entries.size(); ++i) {
+        QFile cpulist(nodeDir.filePath(entries.at(i)) + "/cpulist");
+        if (!cpulist.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        //the cpulist format is comma-separated ranges, e.g. "0-7,16-23"
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        bool any = false;
+        QStringList ranges = QString(cpulist.readAll()).trimmed().split(',');
+        for (int r = 0; r < ranges.size(); ++r) {
+            QStringList bounds = ranges.at(r).split('-');
+            bool ok1 = false, ok2 = false;
+            int lo = bounds.value(0).toInt(&ok1);
+            int hi = (bounds.size() > 1) ? bounds.value(1).toInt(&ok2) : lo;
+            if (!ok1 || (bounds.size() > 1 && !ok2)) {
+                continue;
+            }
+            for (int cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; ++cpu) {
+                CPU_SET(cpu, &set);
+                any = true;
+            }
+        }
+        if (any) {
+            nodes.push_back(set);
+        }
+    }
+
+    //a single node means every cpu already shares one memory domain
+    if (nodes.size() < 2) {
+        nodes.clear();
+    }
+    return nodes;
+}
+#endif
+
+
+/*
+ * Pins the calling pool thread to one NUMA node, chosen round-robin, the
+ * first time that thread runs a job (QThreadPool threads persist, so the
+ * pin sticks for the pool's lifetime). Buffers a worker allocates after
+ * the pin are first-touched on its node and thus node-local, which keeps
+ * the deflate working set off the inter-socket links. No-op unless
+ * setNumaAwareWorkers(true) was called, and on single-node or non-Linux
+ * machines.
+ */
+static void pinWorkerThreadToNumaNode()
+{
+#ifdef Q_OS_LINUX
+    if (!s_numaAwareWorkers.load()) {
+        return;
+    }
+
+    static thread_local bool pinned = false;
+    if (pinned) {
+        return;
+    }
+    pinned = true;
+
+    static const std::vector<cpu_set_t> nodes = parseNumaTopology();
+    if (nodes.empty()) {
+        return;
+    }
+
+    static std::atomic<unsigned int> nextNode(0);
+    const cpu_set_t &set = nodes[nextNode.fetch_add(1) % nodes.size()];
+    sched_setaffinity(0, sizeof(cpu_set_t), &set);
+#endif
+}
+
+
+/*!
+ * \brief NrFileCompressor::setNumaAwareWorkers spreads the worker pools across NUMA nodes
+ * \param enabled true to pin every pool worker thread to one node (round-robin across nodes)
+ *
+ * On multi-socket machines an unpinned pool lets the scheduler migrate
+ * workers between sockets, so their megabyte-sized buffers end up accessed
+ * remotely and throughput plateaus well below what the second socket
+ * should add. With this enabled, each worker thread of the parallel and
+ * batch APIs is pinned to one node the first time it runs and allocates
+ * its scratch buffers there (first-touch), making the deflate working set
+ * node-local. The source chunks handed to workers still live where the
+ * reading thread touched them; only the per-worker state is localized.
+ *
+ * A process-wide toggle: flip it once at startup, before the pools spin
+ * up. No-op on single-node machines and on platforms other than Linux.
+ */
+void NrFileCompressor::setNumaAwareWorkers(bool enabled)
+{
+    s_numaAwareWorkers.store(enabled);
+}
+
+
+/*!
+ * \brief NrFileCompressor::numaAwareWorkers
+ * \return true when NUMA-aware worker placement is enabled
+ */
+bool NrFileCompressor::numaAwareWorkers()
+{
+    return s_numaAwareWorkers.load();
+}
+
+
+namespace {
+
+/* runs one batch task on a pool thread and stores its result code */
+class BatchCompressRunnable : public QRunnable
+{
+public:
+    BatchCompressRunnable(const NrFileCompressor::CompressionTask *i_task, int *o_result)
+        : m_task(i_task), m_result(o_result)
+    {
+        setAutoDelete(true);
+    }
+
+    void run()
+    {
+        pinWorkerThreadToNumaNode();
+
+        *m_result = NrFileCompressor::fileCompress(m_task->filename, m_task->srcpath, m_task->dstpath,
+                                                   m_task->algo, m_task->level);
+    }
+
+private:
+    const NrFileCompressor::CompressionTask *m_task;
+    int *m_result;
+};
+
+} //anonymous namespace
+
+
+/*!
+ * \brief NrFileCompressor::fileCompressBatch compresses a list of files concurrently on a shared worker pool
+ * \param tasks the list of (filename, srcpath, dstpath, algo, level) jobs to run
+ * \param threadCount the number of worker threads to use (0 = one per available core)
+ * \return a list with one return code per task, in the same order as \a tasks (same codes as fileCompress())
+ *
+ * Each task is an independent fileCompress() call, so per-file failures do
+ * not stop the rest of the batch: check every entry of the returned list.
+ */
+QList<int> NrFileCompressor::fileCompressBatch(const QList<CompressionTask> &tasks, int threadCount)
+{
+    QList<int> results;
+    if (tasks.isEmpty()) {
+        return results;
+    }
+
+    int workers = (threadCount > 0) ? threadCount : QThread::idealThreadCount();
+    if (workers < 1) {
+        workers = 1;
+    }
+
+    std::vector<int> codes(tasks.size(), 0);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+
+    for (int i = 0; i < tasks.size(); ++i) {
+        pool.start(new BatchCompressRunnable(&tasks.at(i), &codes[i]));
+    }
+
+    pool.waitForDone();
+
+    for (int i = 0; i < tasks.size(); ++i) {
+        results.append(codes[i]);
+    }
+
+    return results;
+}
+
+
 /*******************
  *     ZIP PART    *
  * *****************/
 
+//gzip-only builds (see nrFileCompressor.pri) compile this whole section
+//out together with miniz's archive machinery (MINIZ_NO_ARCHIVE_APIS)
+#ifndef NRFILECOMPRESSOR_NO_ZIP
+
+namespace {
+
+//granularity of the arena's backing blocks; miniz's central-directory
+//growth and scratch buffers fit a handful of these per job
+static const size_t ARENA_BLOCK_SIZE = (256 * 1024);
+
+/*
+ * Bump allocator behind miniz's m_pAlloc/m_pRealloc/m_pFree hooks.
+ * Allocations are carved sequentially out of malloc'ed blocks, free is a
+ * no-op and everything is returned in one shot when the arena dies with
+ * its job. Under batch workloads (thousands of short-lived mz_zip_archive
+ * contexts per minute) this keeps miniz's many small allocations off the
+ * process heap, avoiding fragmentation and allocator lock contention.
+ * Each allocation is prefixed with its size so realloc can copy the old
+ * payload; an arena serves exactly one job on one thread.
+ *
+ * The no-op free means the arena never shrinks while its job runs: paths
+ * that allocate per entry (the extraction loop grabs a read buffer for
+ * every entry it inflates) retain all of it until the job ends, so on
+ * many-entry archives the arena grows with the entry count. Acceptable
+ * for the short single-file jobs it is wired to; do not install it on a
+ * long-running context without sizing that growth first.
+ */
+class MinizArena
+{
+public:
+    MinizArena()
+        : m_blocks(nullptr)
+    { /* empty */ }
+
+    ~MinizArena()
+    {
+        while (m_blocks) {
+            Block *b = m_blocks;
+            m_blocks = b->next;
+            free(b);
+        }
+    }
+
+    /* points the archive's allocation hooks at this arena; call before the init */
+    void install(mz_zip_archive *io_zip)
+    {
+        io_zip->m_pAlloc = &MinizArena::allocHook;
+        io_zip->m_pRealloc = &MinizArena::reallocHook;
+        io_zip->m_pFree = &MinizArena::freeHook;
+        io_zip->m_pAlloc_opaque = this;
+    }
+
+private:
+    /* header of one backing block; the payload bytes follow it */
+    struct Block
+    {
+        Block *next;
+        size_t used;
+        size_t capacity;
+    };
+
+    //every allocation starts with a 16-byte slot holding its payload size
+    static const size_t ARENA_ALIGN = 16;
+    //the block header rounded up to the alignment: payload bytes start at an
+    //ARENA_ALIGN boundary and "used" only ever grows in ARENA_ALIGN steps,
+    //so every pointer handed out is ARENA_ALIGN-aligned
+    static const size_t ARENA_HEADER = (sizeof(Block) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    void *allocate(size_t i_size)
+    {
+        size_t payload = (i_size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+        size_t needed = payload + ARENA_ALIGN;
+
+        if (!m_blocks || m_blocks->used + needed > m_blocks->capacity) {
+            size_t capacity = (needed > ARENA_BLOCK_SIZE) ? needed : ARENA_BLOCK_SIZE;
+            Block *b = static_cast<Block *>(malloc(ARENA_HEADER + capacity));
+            if (!b) {
+                return nullptr;
+            }
+            b->next = m_blocks;
+            b->used = 0;
+            b->capacity = capacity;
+            m_blocks = b;
+        }
+
+        char *base = reinterpret_cast<char *>(m_blocks) + ARENA_HEADER + m_blocks->used;
+        *reinterpret_cast<size_t *>(base) = i_size;
+        m_blocks->used += needed;
+        return base + ARENA_ALIGN;
+    }
+
+    static void *allocHook(void *opaque, size_t items, size_t size)
+    {
+        return static_cast<MinizArena *>(opaque)->allocate(items * size);
+    }
+
+    static void freeHook(void *opaque, void *address)
+    {
+        //bump allocations are reclaimed all at once by the destructor
+        (void)opaque;
+        (void)address;
+    }
+
+    static void *reallocHook(void *opaque, void *address, size_t items, size_t size)
+    {
+        MinizArena *arena = static_cast<MinizArena *>(opaque);
+        size_t newSize = items * size;
+        if (!address) {
+            return arena->allocate(newSize);
+        }
+
+        size_t oldSize = *reinterpret_cast<size_t *>(static_cast<char *>(address) - ARENA_ALIGN);
+        if (newSize <= oldSize) {
+            return address;
+        }
+
+        void *p = arena->allocate(newSize);
+        if (p) {
+            memcpy(p, address, oldSize);
+        }
+        return p;
+    }
+
+    Block *m_blocks;
+
+    MinizArena(const MinizArena &other);
+    MinizArena& operator=(const MinizArena &other);
+};
+
+} //anonymous namespace
+
+
+#ifndef NRFILECOMPRESSOR_NO_ZIP_WRITER
+
 /*!
  * \brief NrFileCompressor::compressZipFile
  * \param i_filename the filename (without path) of the file to be compressed
@@ -131,10 +580,28 @@ NrFileCompressor::getCompressedFilename(const QString &i_fileName, NrFileCompres
  * \param level the level of compression to be used while compressing the ZIP file (0=storing, 6=default, 9=maximum)
  * \return a integer return code, 0 meaning the process was successfull
  * \warning the filename \em cannot contain characters '\', '/' or ':' if it does they will be replaced by "_"
+ * \note sources beyond the classic 4 GB zip limit produce a zip64 archive; uncompressZipFile() reads those natively
  */
 int NrFileCompressor::compressZipFile(const QString &i_filename, const QString &i_srcpath, const QString &i_dstpath, int level)
 {
-    std::cout << "Compressing (ZIP) file " << i_filename.toStdString() << std::endl;
+    return compressZipFile(i_filename, i_srcpath, i_dstpath, level, CompressorOptions());
+}
+
+
+/*!
+ * \brief NrFileCompressor::compressZipFile same as above, with progress reporting and cancellation
+ * \param i_filename the filename (without path) of the file to be compressed
+ * \param i_srcpath the path where the file to be compressed is located
+ * \param i_dstpath the path where the compressed file should be created (it must exists and be writable)
+ * \param level the level of compression to be used while compressing the ZIP file (0=storing, 6=default, 9=maximum)
+ * \param options progress callback and cancellation token (see CompressorOptions)
+ * \return a integer return code, 0 meaning the process was successfull
+ * \note the single miniz add-file call is not interruptible, so cancellation
+ *       is only honored between the init/add/finalize stages and progress is
+ *       reported at the stage boundaries
+ */
+int NrFileCompressor::compressZipFile(const QString &i_filename, const QString &i_srcpath, const QString &i_dstpath, int level, const CompressorOptions &options)
+{
     const char *s_pComment = "Zipped with NrFileCompressor! Invalid chars replaced with _";
 
     QString compressedfilename = getCompressedFilename(i_filename, NrFileCompressor::ZIP_ARCHIVE);
@@ -147,13 +614,37 @@ int NrFileCompressor::compressZipFile(const QString &i_filename, const QString &
         return NrFileCompressor::E_FILE_NOT_OPEN;
     }
 
+    qint64 totalSize = QFileInfo(srcfilename).size();
+    if (options.stats) {
+        options.stats->reset();
+    }
+    if (options.cancelToken && options.cancelToken->load()) {
+        return NrFileCompressor::E_OPERATION_CANCELED;
+    }
+    if (options.progressCallback) {
+        options.progressCallback(0, totalSize);
+    }
+
     mz_zip_archive zip_archive;
 
     //reset the zip archive
     memset(&zip_archive, 0, sizeof(zip_archive));
 
-    //init for writing
-    bool res = mz_zip_writer_init_file(&zip_archive, destfilename.toLatin1().constData(), 0);
+    //per-job arena: miniz's internal allocations are bump-allocated and
+    //released in one shot when the job ends
+    MinizArena arena;
+    if (options.arenaAllocator) {
+        arena.install(&zip_archive);
+    }
+
+    //init for writing; go straight to zip64 when the source cannot fit the
+    //classic 4 GB limits (miniz would also upgrade mid-write, but declaring
+    //it upfront keeps the archive layout consistent from the first entry)
+    mz_uint zipFlags = 0;
+    if (totalSize >= (qint64)0xFFFFFFFF) {
+        zipFlags |= MZ_ZIP_FLAG_WRITE_ZIP64;
+    }
+    bool res = mz_zip_writer_init_file_v2(&zip_archive, destfilename.toLatin1().constData(), 0, zipFlags);
 
     if (!res)
     {
@@ -163,9 +654,37 @@ int NrFileCompressor::compressZipFile(const QString &i_filename, const QString &
 
     // add "filename" file to the archive with a (possibly) modified name "destfilename" (the one that it will be unzipped with)
     // as the original might have some invalid characters in it: '/', '\' or ':'
-    res = mz_zip_writer_add_file(&zip_archive, compressedfilename.toLatin1().constData(),
-                                  srcfilename.toLatin1().constData(),
-                                  s_pComment, (quint16)strlen(s_pComment), level);
+    // When the OS lets us memory-map the source we add it straight from the
+    // mapping (zero copy from the page cache); otherwise we fall back to
+    // miniz's own buffered file reads.
+    QFile srcfile(srcfilename);
+    const uchar *mapped = nullptr;
+    qint64 srcsize = 0;
+    if (srcfile.open(QIODevice::ReadOnly)) {
+        srcsize = srcfile.size();
+        if (srcsize > 0) {
+            mapped = srcfile.map(0, srcsize);
+        }
+    }
+
+    if (level == NrFileCompressor::ADAPTIVE_COMPRESSION_LEVEL) {
+        level = srcfile.isOpen() ? resolveAdaptiveLevel(&srcfile) : MZ_DEFAULT_LEVEL;
+    }
+
+    if (mapped) {
+        MZ_TIME_T mtime = static_cast<MZ_TIME_T>(QFileInfo(srcfile).lastModified().toMSecsSinceEpoch() / 1000);
+        res = mz_zip_writer_add_mem_ex_v2(&zip_archive, compressedfilename.toLatin1().constData(),
+                                          mapped, static_cast<size_t>(srcsize),
+                                          s_pComment, (quint16)strlen(s_pComment), (mz_uint)level,
+                                          0, 0, &mtime, nullptr, 0, nullptr, 0);
+        srcfile.unmap(const_cast<uchar*>(mapped));
+    } else {
+        res = mz_zip_writer_add_file(&zip_archive, compressedfilename.toLatin1().constData(),
+                                      srcfilename.toLatin1().constData(),
+                                      s_pComment, (quint16)strlen(s_pComment), level);
+    }
+    srcfile.close();
+
     if (!res)
     {
         std::cerr << "Error while adding a zip file (" << i_filename.toStdString() << ") to zip archive: "
@@ -173,6 +692,11 @@ int NrFileCompressor::compressZipFile(const QString &i_filename, const QString &
         return EXIT_FAILURE;
     }
 
+    if (options.cancelToken && options.cancelToken->load()) {
+        mz_zip_writer_end(&zip_archive);
+        return NrFileCompressor::E_OPERATION_CANCELED;
+    }
+
     res = mz_zip_writer_finalize_archive(&zip_archive);
     if (!res)
     {
@@ -187,86 +711,1270 @@ int NrFileCompressor::compressZipFile(const QString &i_filename, const QString &
         return EXIT_FAILURE;
     }
 
+    if (options.progressCallback) {
+        options.progressCallback(totalSize, totalSize);
+    }
+
+    //miniz drives its own chunking and I/O inside the add call, so the zip
+    //path only fills the byte counts (the stage timings stay at zero)
+    if (options.stats) {
+        options.stats->bytesIn = totalSize;
+        options.stats->bytesOut = QFileInfo(destfilename).size();
+    }
+
     return 0;
 }
 
+
 /*!
- * \brief NrFileCompressor::uncompressZipFile method to uncompress a zip archive file
- * \param filename the full path of the zip archive file to be uncompresses
- * \param destDir the destination directory where extracted files will be stored
+ * \brief NrFileCompressor::compressZipBuffer creates a single-entry zip archive in memory, no file I/O involved
+ * \param entryName the name the payload will have inside the archive
+ * \param in the payload to compress
+ * \param out the QByteArray that will receive the complete archive (its previous content is discarded)
+ * \param level the level of compression to be used (0=storing, 6=default, 9=maximum)
  * \return 0 if successful, a negative error code otherwise
- * \note Currently the method skips directories and doesn't preserve files relative path.
- *       Furthermore, files in destDir are overwritten from extracted files having the same name.
+ * \warning the entry name \em cannot contain characters '\', '/' or ':' if it does they will be replaced by "_"
  */
-int NrFileCompressor::uncompressZipFile(const QString &filename, const QString &destDir)
+int NrFileCompressor::compressZipBuffer(const QString &entryName, const QByteArray &in, QByteArray &out, int level)
 {
-    std::cout << "Uncompressing (ZIP) file " << filename.toStdString() << std::endl;
+    QString zipEntryName = calculateNameCompliantWithZipAlgoMiniZ(entryName);
+
+    //the (mz_uint) cast below must never see the adaptive marker
+    if (level == NrFileCompressor::ADAPTIVE_COMPRESSION_LEVEL) {
+        level = resolveAdaptiveLevelFromSample(in.constData(), in.size());
+    }
 
     mz_zip_archive zip_archive;
     memset(&zip_archive, 0, sizeof(zip_archive));
 
-    // init for read
-    bool res = mz_zip_reader_init_file(&zip_archive, filename.toLatin1().constData(), 0);
+    mz_bool res = mz_zip_writer_init_heap(&zip_archive, 0, in.size() + 1024);
     if (!res)
     {
-        std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
-        return EXIT_FAILURE;
+        std::cerr << "Error in initializing heap zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
     }
 
-    uint count = mz_zip_reader_get_num_files(&zip_archive);
-    if (count == 0)
+    res = mz_zip_writer_add_mem(&zip_archive, zipEntryName.toLatin1().constData(),
+                                in.constData(), in.size(), (mz_uint)level);
+    if (!res)
     {
-        mz_zip_reader_end(&zip_archive);
-        return 0;
+        std::cerr << "Error in adding buffer to zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        mz_zip_writer_end(&zip_archive);
+        return NrFileCompressor::E_MINIZ_ERROR;
     }
 
-    // extract the files
-    for (uint i = 0; i < count; ++i)
+    void *pArchive = nullptr;
+    size_t archiveSize = 0;
+    res = mz_zip_writer_finalize_heap_archive(&zip_archive, &pArchive, &archiveSize);
+    if (!res)
     {
-        mz_zip_archive_file_stat file_stat;
-        if (!mz_zip_reader_file_stat(&zip_archive, i, &file_stat))
-        {
-            continue;
-        }
-
-        if (mz_zip_reader_is_file_a_directory(&zip_archive, i))
-        {
-            // skip directories
-            continue;
-        }
-
-        QString destfn = QFileInfo(QString(file_stat.m_filename)).fileName();
-        QString destfilename = QString("%1/%2").arg(!destDir.isEmpty() ? destDir : ".", destfn);
-        
-        res = mz_zip_reader_extract_to_file(&zip_archive, i, destfilename.toLatin1().constData(), 0);
-        if (!res)
-        {
-            std::cerr << "Error while extracting file from zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
-            return EXIT_FAILURE;
-        }
+        std::cerr << "Error while finalizing heap zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        mz_zip_writer_end(&zip_archive);
+        return NrFileCompressor::E_MINIZ_ERROR;
     }
 
-    // close the archive
-    mz_zip_reader_end(&zip_archive);
+    out = QByteArray(static_cast<const char *>(pArchive), (int)archiveSize);
+
+    //finalize detaches the heap buffer from the writer state, so end() will
+    //not release it: it is ours to free once copied into the QByteArray
+    mz_free(pArchive);
+    mz_zip_writer_end(&zip_archive);
 
     return 0;
 }
 
+namespace {
 
-/*********************
- *     gZIP PART     *
- * *******************/
+/*
+ * One entry of a multi-file archive built by compressZipFiles().
+ * A worker thread reads and deflates the file into a private heap buffer;
+ * the main thread then only serializes the (already compressed) bytes and
+ * the central directory bookkeeping into the archive.
+ */
+struct ZipEntryJob
+{
+    QString srcPath;
+    QString entryName;
+    int level;
+
+    QByteArray data;        //uncompressed content (kept only on the store path)
+    void *comp;             //raw deflate stream from tdefl (heap allocated)
+    size_t compSize;
+    quint32 crc;
+    quint64 uncompSize;
+    MZ_TIME_T mtime;
+    bool storeRaw;          //true: add "comp" as pre-compressed data; false: store "data" uncompressed
+    bool ok;
+    QSemaphore done;
+
+    ZipEntryJob()
+        : level(MZ_DEFAULT_LEVEL), comp(nullptr), compSize(0), crc(0), uncompSize(0),
+          mtime(0), storeRaw(false), ok(false)
+    { /* empty */ }
+
+    ~ZipEntryJob()
+    {
+        if (comp) {
+            mz_free(comp);
+        }
+    }
+};
 
 
-quint8 NrFileCompressor::getByte(quint32 var, quint8 bytenum)
+/* reads and deflates one entry on a pool thread */
+class ZipEntryRunnable : public QRunnable
 {
-    int shift;
-    switch(bytenum) {
-    case 1:
-        shift = 8;
-        break;
-    case 2:
-        shift = 16;
+public:
+    explicit ZipEntryRunnable(ZipEntryJob *i_job)
+        : m_job(i_job)
+    {
+        setAutoDelete(true);
+    }
+
+    void run()
+    {
+        pinWorkerThreadToNumaNode();
+
+        ZipEntryJob *job = m_job;
+
+        QFile f(job->srcPath);
+        if (!f.open(QIODevice::ReadOnly)) {
+            std::cerr << "Cannot open file to compress: " << job->srcPath.toStdString() << std::endl;
+            job->done.release();
+            return;
+        }
+
+        job->mtime = static_cast<MZ_TIME_T>(QFileInfo(f).lastModified().toMSecsSinceEpoch() / 1000);
+        job->data = f.readAll();
+        f.close();
+
+        job->uncompSize = static_cast<quint64>(job->data.size());
+        job->crc = static_cast<quint32>(mz_crc32(MZ_CRC32_INIT,
+                                                 reinterpret_cast<const unsigned char*>(job->data.constData()),
+                                                 static_cast<size_t>(job->data.size())));
+
+        //the adaptive marker must be resolved per entry (the content is
+        //already in memory) before it reaches the level checks below
+        if (job->level == NrFileCompressor::ADAPTIVE_COMPRESSION_LEVEL) {
+            job->level = resolveAdaptiveLevelFromSample(job->data.constData(), job->data.size());
+        }
+
+        if (job->level > 0 && job->uncompSize > 0) {
+            //deflate into a private heap buffer (raw stream, no zlib header)
+            mz_uint flags = tdefl_create_comp_flags_from_zip_params(job->level, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+            job->comp = tdefl_compress_mem_to_heap(job->data.constData(), static_cast<size_t>(job->data.size()),
+                                                   &job->compSize, static_cast<int>(flags));
+            if (!job->comp) {
+                std::cerr << "Failed deflating zip entry: " << job->entryName.toStdString() << std::endl;
+                job->done.release();
+                return;
+            }
+            job->storeRaw = true;
+            job->data.clear(); //the uncompressed copy is no longer needed
+        }
+
+        job->ok = true;
+        job->done.release();
+    }
+
+private:
+    ZipEntryJob *m_job;
+};
+
+
+/* adds one finished entry to the archive (main thread only) */
+bool addZipEntryJob(mz_zip_archive *zip, ZipEntryJob *job)
+{
+    if (job->storeRaw) {
+        return mz_zip_writer_add_mem_ex_v2(zip, job->entryName.toLatin1().constData(),
+                                           job->comp, job->compSize, nullptr, 0,
+                                           (mz_uint)job->level | MZ_ZIP_FLAG_COMPRESSED_DATA,
+                                           job->uncompSize, job->crc, &job->mtime,
+                                           nullptr, 0, nullptr, 0);
+    }
+    //store path (level 0 or empty file): the main thread writes the bytes as-is
+    return mz_zip_writer_add_mem_ex_v2(zip, job->entryName.toLatin1().constData(),
+                                       job->data.constData(), static_cast<size_t>(job->data.size()), nullptr, 0,
+                                       0, 0, 0, &job->mtime, nullptr, 0, nullptr, 0);
+}
+
+} //anonymous namespace
+
+
+/*!
+ * \brief NrFileCompressor::compressZipFiles creates one archive from many files, deflating the entries concurrently
+ * \param srcFiles the list of files (with their path) to be added to the archive
+ * \param dstArchive the archive file to be created (with its path); it is overwritten if it exists
+ * \param level the level of compression to be used (0=storing, 6=default, 9=maximum)
+ * \param threadCount the number of worker threads to use (0 = one per available core)
+ * \return a integer return code, 0 meaning the process was successfull
+ * \warning entry names follow the same character sanitization as compressZipFile() and are the bare filenames,
+ *          so two source files with the same name will produce duplicated entries
+ *
+ * The entries are read and deflated in parallel into per-thread scratch
+ * buffers; only the final archive writes and the central-directory
+ * bookkeeping run serialized on the calling thread, so building a bundle
+ * of thousands of artifacts scales with the available cores.
+ */
+int NrFileCompressor::compressZipFiles(const QStringList &srcFiles, const QString &dstArchive, int level, int threadCount)
+{
+    int workers = (threadCount > 0) ? threadCount : QThread::idealThreadCount();
+    if (workers < 1) {
+        workers = 1;
+    }
+
+    mz_zip_archive zip_archive;
+    memset(&zip_archive, 0, sizeof(zip_archive));
+
+    //archives beyond 65535 entries need zip64 central-directory records;
+    //declare it upfront instead of relying on the mid-write upgrade
+    mz_uint zipFlags = 0;
+    if (srcFiles.size() > 0xFFFF) {
+        zipFlags |= MZ_ZIP_FLAG_WRITE_ZIP64;
+    }
+    if (!mz_zip_writer_init_file_v2(&zip_archive, dstArchive.toLatin1().constData(), 0, zipFlags)) {
+        std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+
+    //bound the entries in flight so memory stays at a few files per worker
+    const int maxInFlight = workers * 2;
+
+    std::vector< std::unique_ptr<ZipEntryJob> > jobs;
+    size_t nextToAdd = 0;
+    int ret = 0;
+
+    for (int i = 0; i < srcFiles.size(); ++i) {
+        std::unique_ptr<ZipEntryJob> job(new ZipEntryJob);
+        job->srcPath = srcFiles.at(i);
+        job->entryName = calculateNameCompliantWithZipAlgoMiniZ(QFileInfo(srcFiles.at(i)).fileName());
+        job->level = level;
+
+        jobs.push_back(std::move(job));
+        pool.start(new ZipEntryRunnable(jobs.back().get()));
+
+        while (jobs.size() - nextToAdd >= static_cast<size_t>(maxInFlight)) {
+            ZipEntryJob *j = jobs[nextToAdd].get();
+            j->done.acquire();
+            if (ret == 0) {
+                if (!j->ok) {
+                    ret = NrFileCompressor::E_FILE_NOT_OPEN;
+                } else if (!addZipEntryJob(&zip_archive, j)) {
+                    std::cerr << "Error while adding a zip file (" << j->entryName.toStdString() << ") to zip archive: "
+                              << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+                    ret = NrFileCompressor::E_MINIZ_ERROR;
+                }
+            }
+            jobs[nextToAdd].reset();
+            ++nextToAdd;
+        }
+    }
+
+    //drain the remaining entries in submission order
+    for ( ; nextToAdd < jobs.size(); ++nextToAdd) {
+        ZipEntryJob *j = jobs[nextToAdd].get();
+        j->done.acquire();
+        if (ret == 0) {
+            if (!j->ok) {
+                ret = NrFileCompressor::E_FILE_NOT_OPEN;
+            } else if (!addZipEntryJob(&zip_archive, j)) {
+                std::cerr << "Error while adding a zip file (" << j->entryName.toStdString() << ") to zip archive: "
+                          << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+                ret = NrFileCompressor::E_MINIZ_ERROR;
+            }
+        }
+        jobs[nextToAdd].reset();
+    }
+
+    pool.waitForDone();
+
+    if (ret != 0) {
+        mz_zip_writer_end(&zip_archive);
+        return ret;
+    }
+
+    if (!mz_zip_writer_finalize_archive(&zip_archive)) {
+        std::cerr << "Error while finalizing zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        mz_zip_writer_end(&zip_archive);
+        return EXIT_FAILURE;
+    }
+
+    if (!mz_zip_writer_end(&zip_archive)) {
+        std::cerr << "Error while closing zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
+
+
+/*!
+ * \brief NrFileCompressor::compressZipDirectory archives a whole directory tree into one zip file
+ * \param srcDir the root of the tree to archive
+ * \param dstArchive the full path of the archive file to be created
+ * \param level the level of compression to be used (0=storing, 6=default, 9=maximum)
+ * \param threadCount how many deflate workers to run; 0 (the default) uses QThread::idealThreadCount()
+ * \return 0 if successful, a negative error code otherwise
+ *
+ * Entries keep their paths relative to srcDir ("logs/2018/app.log"), so
+ * the tree unzips back to its original shape - unlike the single-file
+ * calls, whose calculateNameCompliantWithZipAlgoMiniZ() sanitization
+ * flattens '/' to '_' (only '\\' and ':' are replaced here).
+ *
+ * Directory enumeration overlaps with compression: every file found by
+ * the walk is handed straight to a deflate worker while the iterator
+ * advances, and the calling thread serializes finished entries into the
+ * archive in discovery order. A nightly tree snapshot is one pipelined
+ * pass instead of one archive-init/finalize per file.
+ *
+ * \note the entry count is unknown until the walk ends, so zip64 is not
+ *       declared upfront; miniz upgrades the archive mid-write when a
+ *       tree exceeds the classic limits
+ */
+int NrFileCompressor::compressZipDirectory(const QString &srcDir, const QString &dstArchive, int level, int threadCount)
+{
+    QDir root(srcDir);
+    if (!root.exists()) {
+        std::cerr << "Cannot find directory to compress: " << srcDir.toStdString() << std::endl;
+        return NrFileCompressor::E_FILE_NOT_OPEN;
+    }
+
+    int workers = (threadCount > 0) ? threadCount : QThread::idealThreadCount();
+    if (workers < 1) {
+        workers = 1;
+    }
+
+    mz_zip_archive zip_archive;
+    memset(&zip_archive, 0, sizeof(zip_archive));
+
+    if (!mz_zip_writer_init_file_v2(&zip_archive, dstArchive.toLatin1().constData(), 0, 0)) {
+        std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+
+    //bound the entries in flight so memory stays at a few files per worker
+    const int maxInFlight = workers * 2;
+
+    std::vector< std::unique_ptr<ZipEntryJob> > jobs;
+    size_t nextToAdd = 0;
+    int ret = 0;
+
+    QDirIterator it(srcDir, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QString filePath = it.next();
+
+        //relative path preserved; only the characters zip entries cannot
+        //carry portably are replaced (keeping '/' intact)
+        QString entryName = root.relativeFilePath(filePath);
+        entryName.replace("\\", "_");
+        entryName.replace(":", "_");
+
+        std::unique_ptr<ZipEntryJob> job(new ZipEntryJob);
+        job->srcPath = filePath;
+        job->entryName = entryName;
+        job->level = level;
+
+        jobs.push_back(std::move(job));
+        pool.start(new ZipEntryRunnable(jobs.back().get()));
+
+        while (jobs.size() - nextToAdd >= static_cast<size_t>(maxInFlight)) {
+            ZipEntryJob *j = jobs[nextToAdd].get();
+            j->done.acquire();
+            if (ret == 0) {
+                if (!j->ok) {
+                    ret = NrFileCompressor::E_FILE_NOT_OPEN;
+                } else if (!addZipEntryJob(&zip_archive, j)) {
+                    std::cerr << "Error while adding a zip file (" << j->entryName.toStdString() << ") to zip archive: "
+                              << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+                    ret = NrFileCompressor::E_MINIZ_ERROR;
+                }
+            }
+            jobs[nextToAdd].reset();
+            ++nextToAdd;
+        }
+    }
+
+    //drain the remaining entries in discovery order
+    for ( ; nextToAdd < jobs.size(); ++nextToAdd) {
+        ZipEntryJob *j = jobs[nextToAdd].get();
+        j->done.acquire();
+        if (ret == 0) {
+            if (!j->ok) {
+                ret = NrFileCompressor::E_FILE_NOT_OPEN;
+            } else if (!addZipEntryJob(&zip_archive, j)) {
+                std::cerr << "Error while adding a zip file (" << j->entryName.toStdString() << ") to zip archive: "
+                          << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+                ret = NrFileCompressor::E_MINIZ_ERROR;
+            }
+        }
+        jobs[nextToAdd].reset();
+    }
+
+    pool.waitForDone();
+
+    if (ret != 0) {
+        mz_zip_writer_end(&zip_archive);
+        return ret;
+    }
+
+    if (!mz_zip_writer_finalize_archive(&zip_archive)) {
+        std::cerr << "Error while finalizing zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        mz_zip_writer_end(&zip_archive);
+        return EXIT_FAILURE;
+    }
+
+    if (!mz_zip_writer_end(&zip_archive)) {
+        std::cerr << "Error while closing zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
+
+
+/*!
+ * \brief NrFileCompressor::appendToZipFile adds one file to an existing zip archive without rewriting it
+ * \param filename the filename (without path) of the file to be appended
+ * \param srcpath the path where the file to be appended is located
+ * \param archivePath the existing archive to append to
+ * \param level the level of compression to be used (0=storing, 6=default, 9=maximum)
+ * \return 0 if successful, a negative error code otherwise
+ */
+int NrFileCompressor::appendToZipFile(const QString &filename, const QString &srcpath, const QString &archivePath, int level)
+{
+    return appendToZipFile(QStringList() << calculateFilenameWithPath(srcpath, filename), archivePath, level);
+}
+
+
+/*!
+ * \brief NrFileCompressor::appendToZipFile adds files to an existing zip archive without rewriting it
+ * \param srcFiles full paths of the files to append; entry names are the bare filenames, sanitized like compressZipFile()
+ * \param archivePath the existing archive to append to
+ * \param level the level of compression to be used (0=storing, 6=default, 9=maximum)
+ * \return 0 if successful, a negative error code otherwise
+ *
+ * The archive is converted in place from a reader to a writer
+ * (mz_zip_writer_init_from_reader): the existing entry data is left
+ * untouched, new entries are deflated after it and only the central
+ * directory is rewritten at the new end. Appending kilobytes to a
+ * multi-gigabyte bundle therefore costs O(delta), not O(archive).
+ *
+ * \note appending an entry whose name already exists does not remove the
+ *       old one: both records end up in the central directory, and which
+ *       one a reader sees depends on its lookup order. NrZipArchive's
+ *       index keeps the newest record; miniz's own locate returns the
+ *       oldest. A true replace needs a full rewrite (see recompression).
+ * \note the conversion reuses the bytes of the old central directory for
+ *       the first appended entry, so a job that dies mid-append can leave
+ *       the archive without a valid central directory. On a failed add
+ *       this method still finalizes, keeping the archive readable with
+ *       the entries appended up to that point.
+ */
+int NrFileCompressor::appendToZipFile(const QStringList &srcFiles, const QString &archivePath, int level)
+{
+    if (!QFile::exists(archivePath)) {
+        std::cerr << "Cannot find zip archive to append to: " << archivePath.toStdString() << std::endl;
+        return NrFileCompressor::E_FILE_NOT_OPEN;
+    }
+
+    mz_zip_archive zip_archive;
+    memset(&zip_archive, 0, sizeof(zip_archive));
+
+    if (!mz_zip_reader_init_file(&zip_archive, archivePath.toLatin1().constData(), 0)) {
+        std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    if (!mz_zip_writer_init_from_reader_v2(&zip_archive, archivePath.toLatin1().constData(), 0)) {
+        std::cerr << "Error while reopening zip archive for append: "
+                  << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        mz_zip_reader_end(&zip_archive);
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    int ret = 0;
+    for (int i = 0; i < srcFiles.size(); ++i) {
+        const QString &srcfilename = srcFiles.at(i);
+        if (!QFile::exists(srcfilename)) {
+            std::cerr << "Cannot find file to append: " << srcfilename.toStdString() << std::endl;
+            ret = NrFileCompressor::E_FILE_NOT_OPEN;
+            break;
+        }
+
+        //mz_zip_writer_add_file() takes the level as mz_uint flags, so the
+        //adaptive marker has to be resolved (per file) before the call
+        int entryLevel = level;
+        if (entryLevel == NrFileCompressor::ADAPTIVE_COMPRESSION_LEVEL) {
+            QFile srcfile(srcfilename);
+            entryLevel = srcfile.open(QIODevice::ReadOnly) ? resolveAdaptiveLevel(&srcfile) : MZ_DEFAULT_LEVEL;
+        }
+
+        QString entryName = calculateNameCompliantWithZipAlgoMiniZ(QFileInfo(srcfilename).fileName());
+        if (!mz_zip_writer_add_file(&zip_archive, entryName.toLatin1().constData(),
+                                    srcfilename.toLatin1().constData(),
+                                    nullptr, 0, entryLevel)) {
+            std::cerr << "Error while appending file (" << entryName.toStdString() << ") to zip archive: "
+                      << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+            ret = NrFileCompressor::E_MINIZ_ERROR;
+            break;
+        }
+    }
+
+    //finalize even after a failed add: the old entries plus the ones
+    //appended so far stay reachable through a fresh central directory
+    if (!mz_zip_writer_finalize_archive(&zip_archive)) {
+        std::cerr << "Error while finalizing zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        mz_zip_writer_end(&zip_archive);
+        return (ret != 0) ? ret : NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    if (!mz_zip_writer_end(&zip_archive)) {
+        std::cerr << "Error while closing zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        return (ret != 0) ? ret : NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    return ret;
+}
+
+namespace {
+
+/* true when recompressing the entry at the requested level could not change
+   its bytes, so it can be raw-copied into the new archive. The PKZIP
+   general-purpose bits 1-2 record the deflate effort class the original
+   writer used (maximum / fast / super fast); "normal" shares the encoding
+   with "not recorded" (miniz itself writes 0), so those entries are always
+   recompressed rather than wrongly skipped. */
+bool zipEntryAlreadyAtLevel(const mz_zip_archive_file_stat &st, int level)
+{
+    if (st.m_method == 0) {
+        return level == 0 || st.m_uncomp_size == 0;
+    }
+    if (st.m_method != MZ_DEFLATED) {
+        return false;
+    }
+    switch ((st.m_bit_flag >> 1) & 3) {
+        case 1:  return level >= 8;     //maximum
+        case 2:  return level == 2;     //fast
+        case 3:  return level == 1;     //super fast
+        default: return false;          //normal or unrecorded
+    }
+}
+
+
+/*
+ * One recompression worker. Each worker owns its own mz_zip_reader over the
+ * shared mapping (or the file, when mapping failed) and pulls entry indices
+ * from the shared counter, filling the matching ZipEntryJob with the entry
+ * deflated at the new level; the calling thread serializes the adds. The
+ * budget semaphore bounds how many finished-but-unwritten entries exist, so
+ * memory stays at a few entries per worker.
+ */
+class ZipRecompressWorker : public QRunnable
+{
+public:
+    ZipRecompressWorker(const uchar *i_mapped, qint64 i_size, const QString &i_archivePath,
+                        std::vector< std::unique_ptr<ZipEntryJob> > *io_jobs,
+                        std::atomic<unsigned int> *io_nextIndex, unsigned int i_count,
+                        int i_level, QSemaphore *io_budget)
+        : m_mapped(i_mapped), m_size(i_size), m_archivePath(i_archivePath),
+          m_jobs(io_jobs), m_nextIndex(io_nextIndex), m_count(i_count),
+          m_level(i_level), m_budget(io_budget)
+    {
+        setAutoDelete(true);
+    }
+
+    void run()
+    {
+        pinWorkerThreadToNumaNode();
+
+        mz_zip_archive zip;
+        memset(&zip, 0, sizeof(zip));
+
+        bool readerOk;
+        if (m_mapped) {
+            readerOk = mz_zip_reader_init_mem(&zip, m_mapped, static_cast<size_t>(m_size), 0);
+        } else {
+            readerOk = mz_zip_reader_init_file(&zip, m_archivePath.toLatin1().constData(), 0);
+        }
+
+        for ( ; ; ) {
+            //a permit is held *before* claiming an index: the drain loop
+            //consumes strictly in entry order, so the worker owning the
+            //entry it waits on must already hold a permit - claiming first
+            //could leave that worker blocked on a budget the later entries
+            //exhausted, deadlocking against the drain loop
+            m_budget->acquire();
+
+            unsigned int i = m_nextIndex->fetch_add(1);
+            if (i >= m_count) {
+                m_budget->release();
+                break;
+            }
+
+            ZipEntryJob *job = (*m_jobs)[i].get();
+            if (!job) {
+                m_budget->release();
+                continue; //raw-copied entry, handled by the calling thread
+            }
+
+            bool ok = readerOk;
+            mz_zip_archive_file_stat st;
+            if (ok && !mz_zip_reader_file_stat(&zip, i, &st)) {
+                ok = false;
+            }
+
+            void *pUncomp = nullptr;
+            size_t uncompSize = 0;
+            if (ok) {
+                job->entryName = QString(st.m_filename);
+                job->uncompSize = st.m_uncomp_size;
+                job->crc = static_cast<quint32>(st.m_crc32);
+                job->mtime = st.m_time;
+                job->level = m_level;
+
+                if (st.m_uncomp_size > 0) {
+                    pUncomp = mz_zip_reader_extract_to_heap(&zip, i, &uncompSize, 0);
+                    if (!pUncomp) {
+                        std::cerr << "Failed extracting zip entry for recompression: " << st.m_filename << std::endl;
+                        ok = false;
+                    }
+                }
+            }
+
+            if (ok) {
+                //the adaptive marker is resolved per entry from the freshly
+                //inflated bytes; the level checks below must never see it
+                int entryLevel = m_level;
+                if (entryLevel == NrFileCompressor::ADAPTIVE_COMPRESSION_LEVEL && uncompSize > 0) {
+                    entryLevel = resolveAdaptiveLevelFromSample(static_cast<const char *>(pUncomp),
+                                                               static_cast<qint64>(uncompSize));
+                    job->level = entryLevel;
+                }
+                if (entryLevel > 0 && uncompSize > 0) {
+                    mz_uint flags = tdefl_create_comp_flags_from_zip_params(entryLevel, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+                    job->comp = tdefl_compress_mem_to_heap(pUncomp, uncompSize, &job->compSize, static_cast<int>(flags));
+                    if (job->comp) {
+                        job->storeRaw = true;
+                    } else {
+                        std::cerr << "Failed deflating zip entry: " << job->entryName.toStdString() << std::endl;
+                        ok = false;
+                    }
+                } else {
+                    job->data = QByteArray(static_cast<const char *>(pUncomp), static_cast<int>(uncompSize));
+                }
+            }
+
+            if (pUncomp) {
+                mz_free(pUncomp);
+            }
+
+            job->ok = ok;
+            job->done.release();
+        }
+
+        if (readerOk) {
+            mz_zip_reader_end(&zip);
+        }
+    }
+
+private:
+    const uchar *m_mapped;
+    qint64 m_size;
+    QString m_archivePath;
+    std::vector< std::unique_ptr<ZipEntryJob> > *m_jobs;
+    std::atomic<unsigned int> *m_nextIndex;
+    unsigned int m_count;
+    int m_level;
+    QSemaphore *m_budget;
+};
+
+} //anonymous namespace
+
+
+/*!
+ * \brief NrFileCompressor::recompressZipFile rebuilds an archive with every entry recompressed at a new level
+ * \param srcArchive the full path of the archive to migrate
+ * \param dstArchive the full path of the archive to create (must differ from srcArchive)
+ * \param level the target compression level (0=storing, 6=default, 9=maximum)
+ * \param threadCount how many recompression workers to run; 0 (the default) uses QThread::idealThreadCount()
+ * \return 0 if successful, a negative error code otherwise
+ *
+ * The level-migration path: entries stream from the source reader straight
+ * into the destination writer, so the cost approaches one sequential read
+ * plus one sequential write of the archive - no extract-to-disk roundtrip
+ * and no doubled peak disk usage beyond the destination itself.
+ *
+ * Entries that recompression could not change - directories, stored
+ * entries when the target is storing, encrypted entries, and deflated
+ * entries whose recorded effort class already matches the target level
+ * (see zipEntryAlreadyAtLevel()) - are raw-copied compressed-as-is via
+ * mz_zip_writer_add_from_zip_reader(), skipping both inflate and deflate.
+ * Everything else is inflated and re-deflated by a pool of workers, each
+ * holding its own reader over one shared mapping of the source; the
+ * calling thread serializes the adds in entry order.
+ */
+int NrFileCompressor::recompressZipFile(const QString &srcArchive, const QString &dstArchive, int level, int threadCount)
+{
+    int workers = (threadCount > 0) ? threadCount : QThread::idealThreadCount();
+    if (workers < 1) {
+        workers = 1;
+    }
+
+    QFile archive(srcArchive);
+    if (!archive.open(QIODevice::ReadOnly)) {
+        std::cerr << "Cannot open zip archive: " << srcArchive.toStdString() << std::endl;
+        return NrFileCompressor::E_FILE_NOT_OPEN;
+    }
+
+    qint64 archiveSize = archive.size();
+    const uchar *mapped = (archiveSize > 0) ? archive.map(0, archiveSize) : nullptr;
+
+    //the calling thread's reader: entry metadata for the triage plus the
+    //source half of the raw copies
+    mz_zip_archive src;
+    memset(&src, 0, sizeof(src));
+    bool res;
+    if (mapped) {
+        res = mz_zip_reader_init_mem(&src, mapped, static_cast<size_t>(archiveSize), 0);
+    } else {
+        res = mz_zip_reader_init_file(&src, srcArchive.toLatin1().constData(), 0);
+    }
+    if (!res) {
+        std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&src)) << std::endl;
+        if (mapped) {
+            archive.unmap(const_cast<uchar*>(mapped));
+        }
+        archive.close();
+        return EXIT_FAILURE;
+    }
+
+    unsigned int count = mz_zip_reader_get_num_files(&src);
+
+    mz_zip_archive dst;
+    memset(&dst, 0, sizeof(dst));
+    mz_uint zipFlags = 0;
+    if (count > 0xFFFF || archiveSize >= (qint64)0xFFFFFFFF) {
+        zipFlags |= MZ_ZIP_FLAG_WRITE_ZIP64;
+    }
+    if (!mz_zip_writer_init_file_v2(&dst, dstArchive.toLatin1().constData(), 0, zipFlags)) {
+        std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&dst)) << std::endl;
+        mz_zip_reader_end(&src);
+        if (mapped) {
+            archive.unmap(const_cast<uchar*>(mapped));
+        }
+        archive.close();
+        return EXIT_FAILURE;
+    }
+
+    //triage: entries the new level cannot change get no job and are
+    //raw-copied in the drain loop below
+    std::vector< std::unique_ptr<ZipEntryJob> > jobs(count);
+    for (unsigned int i = 0; i < count; ++i) {
+        mz_zip_archive_file_stat st;
+        bool raw = true;
+        if (mz_zip_reader_file_stat(&src, i, &st)) {
+            raw = mz_zip_reader_is_file_a_directory(&src, i)
+                  || mz_zip_reader_is_file_encrypted(&src, i)
+                  || zipEntryAlreadyAtLevel(st, level);
+        }
+        if (!raw) {
+            jobs[i].reset(new ZipEntryJob);
+        }
+    }
+
+    //bound the finished-but-unwritten entries so memory stays at a few per worker
+    QSemaphore budget(workers * 2);
+    std::atomic<unsigned int> nextIndex(0);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+    for (int w = 0; w < workers; ++w) {
+        pool.start(new ZipRecompressWorker(mapped, archiveSize, srcArchive, &jobs, &nextIndex, count, level, &budget));
+    }
+
+    //drain in entry order; after a failure the loop keeps consuming jobs so
+    //the workers never block forever on the budget semaphore
+    int ret = 0;
+    for (unsigned int i = 0; i < count; ++i) {
+        ZipEntryJob *job = jobs[i].get();
+        if (!job) {
+            if (ret == 0 && !mz_zip_writer_add_from_zip_reader(&dst, &src, i)) {
+                std::cerr << "Error while raw-copying zip entry to new archive: "
+                          << mz_zip_get_error_string(mz_zip_get_last_error(&dst)) << std::endl;
+                ret = NrFileCompressor::E_MINIZ_ERROR;
+            }
+            continue;
+        }
+
+        job->done.acquire();
+        if (ret == 0) {
+            if (!job->ok) {
+                ret = NrFileCompressor::E_MINIZ_ERROR;
+            } else if (!addZipEntryJob(&dst, job)) {
+                std::cerr << "Error while adding a zip file (" << job->entryName.toStdString() << ") to zip archive: "
+                          << mz_zip_get_error_string(mz_zip_get_last_error(&dst)) << std::endl;
+                ret = NrFileCompressor::E_MINIZ_ERROR;
+            }
+        }
+        jobs[i].reset();
+        budget.release();
+    }
+
+    pool.waitForDone();
+    mz_zip_reader_end(&src);
+    if (mapped) {
+        archive.unmap(const_cast<uchar*>(mapped));
+    }
+    archive.close();
+
+    if (ret != 0) {
+        mz_zip_writer_end(&dst);
+        return ret;
+    }
+
+    if (!mz_zip_writer_finalize_archive(&dst)) {
+        std::cerr << "Error while finalizing zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&dst)) << std::endl;
+        mz_zip_writer_end(&dst);
+        return EXIT_FAILURE;
+    }
+
+    if (!mz_zip_writer_end(&dst)) {
+        std::cerr << "Error while closing zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&dst)) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
+
+
+#endif //NRFILECOMPRESSOR_NO_ZIP_WRITER
+
+
+/*!
+ * \brief NrFileCompressor::uncompressZipFile method to uncompress a zip archive file
+ * \param filename the full path of the zip archive file to be uncompresses
+ * \param destDir the destination directory where extracted files will be stored
+ * \return 0 if successful, a negative error code otherwise
+ * \note Currently the method skips directories and doesn't preserve files relative path.
+ *       Furthermore, files in destDir are overwritten from extracted files having the same name.
+ */
+int NrFileCompressor::uncompressZipFile(const QString &filename, const QString &destDir)
+{
+    return uncompressZipFile(filename, destDir, CompressorOptions());
+}
+
+
+/*!
+ * \brief NrFileCompressor::uncompressZipFile same as above, with progress reporting and cancellation
+ * \param filename the full path of the zip archive file to be uncompresses
+ * \param destDir the destination directory where extracted files will be stored
+ * \param options progress callback and cancellation token (see CompressorOptions)
+ * \return 0 if successful, a negative error code otherwise
+ * \note the progress callback is invoked with (extracted entries, total entries),
+ *       not bytes, and cancellation is honored between entries
+ */
+int NrFileCompressor::uncompressZipFile(const QString &filename, const QString &destDir, const CompressorOptions &options)
+{
+    mz_zip_archive zip_archive;
+    memset(&zip_archive, 0, sizeof(zip_archive));
+
+    //per-job arena for miniz's read buffers and central-directory state
+    MinizArena arena;
+    if (options.arenaAllocator) {
+        arena.install(&zip_archive);
+    }
+
+    // init for read
+    bool res = mz_zip_reader_init_file(&zip_archive, filename.toLatin1().constData(), 0);
+    if (!res)
+    {
+        std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    uint count = mz_zip_reader_get_num_files(&zip_archive);
+    if (count == 0)
+    {
+        mz_zip_reader_end(&zip_archive);
+        return 0;
+    }
+
+    // extract the files
+    for (uint i = 0; i < count; ++i)
+    {
+        if (options.cancelToken && options.cancelToken->load())
+        {
+            mz_zip_reader_end(&zip_archive);
+            return NrFileCompressor::E_OPERATION_CANCELED;
+        }
+
+        mz_zip_archive_file_stat file_stat;
+        if (!mz_zip_reader_file_stat(&zip_archive, i, &file_stat))
+        {
+            continue;
+        }
+
+        if (mz_zip_reader_is_file_a_directory(&zip_archive, i))
+        {
+            // skip directories
+            continue;
+        }
+
+        QString destfn = QFileInfo(QString(file_stat.m_filename)).fileName();
+        QString destfilename = QString("%1/%2").arg(!destDir.isEmpty() ? destDir : ".", destfn);
+        
+        res = mz_zip_reader_extract_to_file(&zip_archive, i, destfilename.toLatin1().constData(), 0);
+        if (!res)
+        {
+            std::cerr << "Error while extracting file from zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if (options.progressCallback)
+        {
+            options.progressCallback(i + 1, count);
+        }
+    }
+
+    // close the archive
+    mz_zip_reader_end(&zip_archive);
+
+    return 0;
+}
+
+
+/*!
+ * \brief NrFileCompressor::uncompressZipEntry extracts a single entry from a zip archive, leaving the rest untouched
+ * \param filename the full path of the zip archive file
+ * \param entryName the name of the entry inside the archive (as stored, i.e. after the compression-time character sanitization)
+ * \param destDir the destination directory where the extracted file will be stored
+ * \return 0 if successful, a negative error code otherwise (E_FILE_NOT_OPEN when the entry does not exist)
+ *
+ * The entry is found through the central directory (mz_zip_reader_locate_file),
+ * so pulling one small file out of a multi-gigabyte bundle costs one lookup
+ * and one inflate instead of a full-archive extraction.
+ */
+int NrFileCompressor::uncompressZipEntry(const QString &filename, const QString &entryName, const QString &destDir)
+{
+    mz_zip_archive zip_archive;
+    memset(&zip_archive, 0, sizeof(zip_archive));
+
+    if (!mz_zip_reader_init_file(&zip_archive, filename.toLatin1().constData(), 0))
+    {
+        std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    int index = mz_zip_reader_locate_file(&zip_archive, entryName.toLatin1().constData(), nullptr, 0);
+    if (index < 0)
+    {
+        std::cerr << "Entry not found in zip archive: " << entryName.toStdString() << std::endl;
+        mz_zip_reader_end(&zip_archive);
+        return NrFileCompressor::E_FILE_NOT_OPEN;
+    }
+
+    QString destfn = QFileInfo(entryName).fileName();
+    QString destfilename = QString("%1/%2").arg(!destDir.isEmpty() ? destDir : ".", destfn);
+
+    if (!mz_zip_reader_extract_to_file(&zip_archive, index, destfilename.toLatin1().constData(), 0))
+    {
+        std::cerr << "Error while extracting file from zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        mz_zip_reader_end(&zip_archive);
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    mz_zip_reader_end(&zip_archive);
+    return 0;
+}
+
+
+/*!
+ * \brief NrFileCompressor::uncompressZipEntryToBuffer extracts a single entry straight into memory, no file is created
+ * \param filename the full path of the zip archive file
+ * \param entryName the name of the entry inside the archive
+ * \param out the QByteArray that will receive the decompressed entry (its previous content is discarded)
+ * \return 0 if successful, a negative error code otherwise (E_FILE_NOT_OPEN when the entry does not exist)
+ */
+int NrFileCompressor::uncompressZipEntryToBuffer(const QString &filename, const QString &entryName, QByteArray &out)
+{
+    mz_zip_archive zip_archive;
+    memset(&zip_archive, 0, sizeof(zip_archive));
+
+    if (!mz_zip_reader_init_file(&zip_archive, filename.toLatin1().constData(), 0))
+    {
+        std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    int index = mz_zip_reader_locate_file(&zip_archive, entryName.toLatin1().constData(), nullptr, 0);
+    if (index < 0)
+    {
+        std::cerr << "Entry not found in zip archive: " << entryName.toStdString() << std::endl;
+        mz_zip_reader_end(&zip_archive);
+        return NrFileCompressor::E_FILE_NOT_OPEN;
+    }
+
+    size_t uncompSize = 0;
+    void *pData = mz_zip_reader_extract_to_heap(&zip_archive, index, &uncompSize, 0);
+    if (!pData)
+    {
+        std::cerr << "Error while extracting file from zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        mz_zip_reader_end(&zip_archive);
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    out = QByteArray(static_cast<const char *>(pData), (int)uncompSize);
+    mz_free(pData);
+
+    mz_zip_reader_end(&zip_archive);
+    return 0;
+}
+
+
+/*!
+ * \brief NrFileCompressor::uncompressZipFileFiltered extracts only the entries whose name matches a wildcard pattern
+ * \param filename the full path of the zip archive file
+ * \param destDir the destination directory where extracted files will be stored
+ * \param pattern a glob-style pattern matched against the stored entry names (e.g. "config/*.json" or "manifest-?.xml")
+ * \return the number of entries extracted (>= 0) if successful, a negative error code otherwise
+ */
+int NrFileCompressor::uncompressZipFileFiltered(const QString &filename, const QString &destDir, const QString &pattern)
+{
+    QRegExp matcher(pattern, Qt::CaseSensitive, QRegExp::Wildcard);
+
+    mz_zip_archive zip_archive;
+    memset(&zip_archive, 0, sizeof(zip_archive));
+
+    if (!mz_zip_reader_init_file(&zip_archive, filename.toLatin1().constData(), 0))
+    {
+        std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    uint count = mz_zip_reader_get_num_files(&zip_archive);
+    int extracted = 0;
+
+    for (uint i = 0; i < count; ++i)
+    {
+        mz_zip_archive_file_stat file_stat;
+        if (!mz_zip_reader_file_stat(&zip_archive, i, &file_stat))
+        {
+            continue;
+        }
+
+        if (mz_zip_reader_is_file_a_directory(&zip_archive, i))
+        {
+            // skip directories
+            continue;
+        }
+
+        if (!matcher.exactMatch(QString(file_stat.m_filename)))
+        {
+            continue;
+        }
+
+        QString destfn = QFileInfo(QString(file_stat.m_filename)).fileName();
+        QString destfilename = QString("%1/%2").arg(!destDir.isEmpty() ? destDir : ".", destfn);
+
+        if (!mz_zip_reader_extract_to_file(&zip_archive, i, destfilename.toLatin1().constData(), 0))
+        {
+            std::cerr << "Error while extracting file from zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)) << std::endl;
+            mz_zip_reader_end(&zip_archive);
+            return NrFileCompressor::E_MINIZ_ERROR;
+        }
+        ++extracted;
+    }
+
+    mz_zip_reader_end(&zip_archive);
+    return extracted;
+}
+
+
+namespace {
+
+/*
+ * One extraction worker of uncompressZipFileParallel(). Each worker owns a
+ * private mz_zip_reader over the same memory-mapped archive (the mapping is
+ * read-only, so sharing it between readers is safe) and pulls entry indices
+ * from a shared atomic counter until the archive is exhausted.
+ */
+class ZipExtractRunnable : public QRunnable
+{
+public:
+    ZipExtractRunnable(const uchar *i_mapped, qint64 i_mappedSize, const QString &i_archivePath,
+                       const QString &i_destDir, std::atomic<unsigned int> *io_nextIndex, unsigned int i_count,
+                       std::atomic<int> *o_failures)
+        : m_mapped(i_mapped), m_mappedSize(i_mappedSize), m_archivePath(i_archivePath),
+          m_destDir(i_destDir), m_nextIndex(io_nextIndex), m_count(i_count), m_failures(o_failures)
+    {
+        setAutoDelete(true);
+    }
+
+    void run()
+    {
+        pinWorkerThreadToNumaNode();
+
+        mz_zip_archive zip;
+        memset(&zip, 0, sizeof(zip));
+
+        bool res;
+        if (m_mapped) {
+            res = mz_zip_reader_init_mem(&zip, m_mapped, static_cast<size_t>(m_mappedSize), 0);
+        } else {
+            //mapping failed: every worker opens its own file handle instead
+            res = mz_zip_reader_init_file(&zip, m_archivePath.toLatin1().constData(), 0);
+        }
+        if (!res) {
+            std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&zip)) << std::endl;
+            m_failures->fetch_add(1);
+            return;
+        }
+
+        for ( ; ; ) {
+            unsigned int i = m_nextIndex->fetch_add(1);
+            if (i >= m_count) {
+                break;
+            }
+
+            mz_zip_archive_file_stat file_stat;
+            if (!mz_zip_reader_file_stat(&zip, i, &file_stat)) {
+                continue;
+            }
+
+            if (mz_zip_reader_is_file_a_directory(&zip, i)) {
+                // skip directories
+                continue;
+            }
+
+            QString destfn = QFileInfo(QString(file_stat.m_filename)).fileName();
+            QString destfilename = QString("%1/%2").arg(!m_destDir.isEmpty() ? m_destDir : ".", destfn);
+
+            if (!mz_zip_reader_extract_to_file(&zip, i, destfilename.toLatin1().constData(), 0)) {
+                std::cerr << "Error while extracting file from zip archive: "
+                          << mz_zip_get_error_string(mz_zip_get_last_error(&zip)) << std::endl;
+                m_failures->fetch_add(1);
+            }
+        }
+
+        mz_zip_reader_end(&zip);
+    }
+
+private:
+    const uchar *m_mapped;
+    qint64 m_mappedSize;
+    QString m_archivePath;
+    QString m_destDir;
+    std::atomic<unsigned int> *m_nextIndex;
+    unsigned int m_count;
+    std::atomic<int> *m_failures;
+};
+
+} //anonymous namespace
+
+
+/*!
+ * \brief NrFileCompressor::uncompressZipFileParallel extracts a zip archive using a pool of worker threads
+ * \param filename the full path of the zip archive file to be uncompresses
+ * \param destDir the destination directory where extracted files will be stored
+ * \param threadCount the number of worker threads to use (0 = one per available core)
+ * \return 0 if successful, a negative error code otherwise
+ * \note Same semantics as uncompressZipFile(): directories are skipped, relative paths
+ *       are not preserved and files with the same name overwrite each other.
+ *
+ * The archive is memory-mapped once and every worker holds its own
+ * mz_zip_reader over that read-only mapping, pulling entry indices from a
+ * shared queue; entries are therefore decompressed fully in parallel.
+ */
+int NrFileCompressor::uncompressZipFileParallel(const QString &filename, const QString &destDir, int threadCount)
+{
+    int workers = (threadCount > 0) ? threadCount : QThread::idealThreadCount();
+    if (workers < 1) {
+        workers = 1;
+    }
+
+    QFile archive(filename);
+    if (!archive.open(QIODevice::ReadOnly)) {
+        std::cerr << "Cannot open zip archive: " << filename.toStdString() << std::endl;
+        return NrFileCompressor::E_FILE_NOT_OPEN;
+    }
+
+    qint64 archiveSize = archive.size();
+    const uchar *mapped = (archiveSize > 0) ? archive.map(0, archiveSize) : nullptr;
+
+    //probe the archive once to get the entry count (and fail early on junk)
+    mz_zip_archive zip;
+    memset(&zip, 0, sizeof(zip));
+    bool res;
+    if (mapped) {
+        res = mz_zip_reader_init_mem(&zip, mapped, static_cast<size_t>(archiveSize), 0);
+    } else {
+        res = mz_zip_reader_init_file(&zip, filename.toLatin1().constData(), 0);
+    }
+    if (!res) {
+        std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&zip)) << std::endl;
+        if (mapped) {
+            archive.unmap(const_cast<uchar*>(mapped));
+        }
+        archive.close();
+        return EXIT_FAILURE;
+    }
+
+    unsigned int count = mz_zip_reader_get_num_files(&zip);
+    mz_zip_reader_end(&zip);
+
+    if (count == 0) {
+        if (mapped) {
+            archive.unmap(const_cast<uchar*>(mapped));
+        }
+        archive.close();
+        return 0;
+    }
+
+    if (workers > static_cast<int>(count)) {
+        workers = static_cast<int>(count);
+    }
+
+    std::atomic<unsigned int> nextIndex(0);
+    std::atomic<int> failures(0);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+    for (int w = 0; w < workers; ++w) {
+        pool.start(new ZipExtractRunnable(mapped, archiveSize, filename, destDir, &nextIndex, count, &failures));
+    }
+    pool.waitForDone();
+
+    if (mapped) {
+        archive.unmap(const_cast<uchar*>(mapped));
+    }
+    archive.close();
+
+    return (failures.load() == 0) ? 0 : EXIT_FAILURE;
+}
+
+#endif //NRFILECOMPRESSOR_NO_ZIP
+
+
+/*********************
+ *     gZIP PART     *
+ * *******************/
+
+
+quint8 NrFileCompressor::getByte(quint32 var, quint8 bytenum)
+{
+    int shift;
+    switch(bytenum) {
+    case 1:
+        shift = 8;
+        break;
+    case 2:
+        shift = 16;
         break;
     case 3:
         shift = 24;
@@ -275,89 +1983,1276 @@ quint8 NrFileCompressor::getByte(quint32 var, quint8 bytenum)
         shift = 0;
         break;
     }
-    return (var >> shift) & 0xFF;
+    return (var >> shift) & 0xFF;
+}
+
+
+int NrFileCompressor::writeGzipHeader(QIODevice *pFile, quint32 i_mtime)
+{
+    /*
+        It builds the GZIP file structure with his header and footer in this format:
+        (http://www.zlib.org/rfc-gzip.html)
+
+        +---+---+---+---+---+---+---+---+---+---+=============================+---+---+---+---+---+---+---+---+
+        |ID1|ID2|CM |FLG|     MTIME     |XFL|OS |   ....COMPRESSED DATA....   |     CRC32     |     ISIZE     |
+        +---+---+---+---+---+---+---+---+---+---+=============================+---+---+---+---+---+---+---+---+
+
+        The first 10 bytes header is fixed, the CRC32 is the checksum of uncompressed data
+        and the ISIZE is the size of uncompressed data in bytes.
+     */
+    const char id1      = 31;   //Fixed value identifying GZip
+    const char  id2     = 139;  //Fixed value identifying GZip
+    const char  cm      = 8;    //(Fixed value identifying GZip) is the standard deflate method
+    const char  flg     = 0;    //0 means no extra flags
+    quint8 mtime[4];
+    const char  xflg    = 0;    //0 means no extra flags
+
+#ifdef WIN32
+    const char  os      = 0;    //0 is Dos/win, 3 is Unix-style (used for line endings)
+#else
+    const char  os      = 3;    //0 is Dos/win, 3 is Unix-style (used for line endings)
+#endif
+
+    mtime[0] = getByte(i_mtime, 0);
+    mtime[1] = getByte(i_mtime, 1);
+    mtime[2] = getByte(i_mtime, 2);
+    mtime[3] = getByte(i_mtime, 3);
+
+
+    pFile->write(&id1, 1);
+    pFile->write(&id2, 1);
+    pFile->write(&cm, 1);
+    pFile->write(&flg, 1);
+    pFile->write((const char*) &mtime, 4);
+    pFile->write(&xflg, 1);
+    pFile->write(&os, 1);
+
+    return 0;
+}
+
+
+int NrFileCompressor::writeGzipFooter(QIODevice *pFile, quint32 i_crc32, quint32 i_size)
+{
+    quint8 size[4];
+    size[0] = getByte(i_size, 0);
+    size[1] = getByte(i_size, 1);
+    size[2] = getByte(i_size, 2);
+    size[3] = getByte(i_size, 3);
+
+    quint8 crc32[4];
+    crc32[0] = getByte(i_crc32, 0);
+    crc32[1] = getByte(i_crc32, 1);
+    crc32[2] = getByte(i_crc32, 2);
+    crc32[3] = getByte(i_crc32, 3);
+
+    pFile->write((const char*) &crc32, 4);
+    pFile->write((const char*) &size, 4);
+
+    return 0;
+}
+
+
+/*!
+ * \brief NrFileCompressor::compressGzipFile
+ * \param i_filename the filename (without path) of the file to be compressed
+ * \param i_srcpath the path where the file to be compressed is located
+ * \param i_dstpath the path where the compressed file should be created (it must exists and be writable)
+ * \param level the level of compression to be used while compressing the GZIP file (0=storing, 6=default, 9=maximum)
+ * \return a integer return code, 0 meaning the process was successfull
+ */
+int NrFileCompressor::compressGzipFile(const QString &i_filename, const QString &i_srcpath, const QString &i_dstpath, int level)
+{
+    return compressGzipFileHooked(i_filename, i_srcpath, i_dstpath, level, ProgressCallback(), nullptr);
+}
+
+
+/*!
+ * \brief NrFileCompressor::compressGzipFile same as above, with progress reporting and cancellation
+ * \param i_filename the filename (without path) of the file to be compressed
+ * \param i_srcpath the path where the file to be compressed is located
+ * \param i_dstpath the path where the compressed file should be created (it must exists and be writable)
+ * \param level the level of compression to be used while compressing the GZIP file (0=storing, 6=default, 9=maximum)
+ * \param options progress callback (throttled to options.progressGranularity bytes) and cancellation token
+ * \return a integer return code, 0 meaning the process was successfull
+ */
+int NrFileCompressor::compressGzipFile(const QString &i_filename, const QString &i_srcpath, const QString &i_dstpath, int level, const CompressorOptions &options)
+{
+    ProgressCallback cb;
+    if (options.progressCallback) {
+        //throttle the per-chunk callbacks of the inner loop down to the requested granularity
+        qint64 granularity = (options.progressGranularity > 0) ? options.progressGranularity : 1;
+        ProgressCallback userCb = options.progressCallback;
+        std::shared_ptr<qint64> lastReported(new qint64(0));
+        cb = [granularity, userCb, lastReported](qint64 processed, qint64 total) {
+            if ((processed - *lastReported >= granularity) || processed == total) {
+                *lastReported = processed;
+                userCb(processed, total);
+            }
+        };
+    }
+    return compressGzipFileHooked(i_filename, i_srcpath, i_dstpath, level, cb, options.cancelToken, &options);
+}
+
+
+//size of the gzip working buffers (heap allocated: Visual Studio caps the stack at 1MB)
+static const qint64 GZIP_BUF_SIZE = (1024 * 1024);
+
+
+#ifdef Q_OS_LINUX
+
+namespace {
+
+/*
+ * QIODevice sink writing through O_DIRECT: compressed output is staged in a
+ * page-aligned buffer and hits the disk in full aligned writes, bypassing the
+ * page cache so cold archive data does not evict anybody's hot working set.
+ * The unaligned tail is written with O_DIRECT cleared on finish().
+ */
+class DirectWriteDevice : public QIODevice
+{
+public:
+    DirectWriteDevice(const QString &path, qint64 bufSize)
+        : m_path(path), m_fd(-1), m_buf(nullptr), m_fill(0)
+    {
+        //O_DIRECT wants page-aligned sizes: round up to a 4 KB multiple
+        m_bufSize = (size_t)((bufSize < 4096 ? 4096 : bufSize) + 4095) & ~(size_t)4095;
+    }
+
+    ~DirectWriteDevice()
+    {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+        free(m_buf);
+    }
+
+    bool openDirect()
+    {
+        if (posix_memalign(&m_buf, 4096, m_bufSize) != 0) {
+            return false;
+        }
+        m_fd = ::open(QFile::encodeName(m_path).constData(),
+                      O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (m_fd < 0) {
+            return false; //filesystem without O_DIRECT support: caller falls back to buffered
+        }
+        return QIODevice::open(QIODevice::WriteOnly);
+    }
+
+    /* flushes the unaligned tail (with O_DIRECT dropped) and optionally tells
+       the kernel the written pages will not be needed again */
+    bool finish(bool dropCache)
+    {
+        bool ok = true;
+        if (m_fill > 0) {
+            int fl = fcntl(m_fd, F_GETFL);
+            fcntl(m_fd, F_SETFL, fl & ~O_DIRECT);
+            ok = writeFully((const char *)m_buf, m_fill);
+            m_fill = 0;
+        }
+        if (ok && dropCache) {
+            posix_fadvise(m_fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+        return ok;
+    }
+
+    bool isSequential() const { return true; }
+
+protected:
+    qint64 readData(char *, qint64) { return -1; }
+
+    qint64 writeData(const char *data, qint64 len)
+    {
+        qint64 left = len;
+        while (left > 0) {
+            size_t room = m_bufSize - m_fill;
+            size_t n = (left < (qint64)room) ? (size_t)left : room;
+            memcpy((char *)m_buf + m_fill, data, n);
+            m_fill += n;
+            data += n;
+            left -= n;
+            if (m_fill == m_bufSize) {
+                if (!writeFully((const char *)m_buf, m_bufSize)) {
+                    return -1;
+                }
+                m_fill = 0;
+            }
+        }
+        return len;
+    }
+
+private:
+    bool writeFully(const char *data, size_t len)
+    {
+        while (len > 0) {
+            ssize_t w = ::write(m_fd, data, len);
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Error writing compressed output (direct I/O)" << std::endl;
+                return false;
+            }
+            data += w;
+            len -= (size_t)w;
+        }
+        return true;
+    }
+
+    QString m_path;
+    int m_fd;
+    void *m_buf;
+    size_t m_bufSize;
+    size_t m_fill;
+};
+
+} //anonymous namespace
+
+#endif //Q_OS_LINUX
+
+/*
+ * The reusable gzip working state behind NrCompressorContext: the two 1 MB
+ * buffers and the miniz deflate stream. prepare() is called at the start of
+ * every file/stream: the first time (or when the level changes) it runs a
+ * full deflateInit2, afterwards just a cheap deflateReset, so a context
+ * reused across a batch of files pays the setup cost only once.
+ */
+struct NrCompressorContextPrivate
+{
+    std::unique_ptr<unsigned char[]> inbuf;
+    std::unique_ptr<unsigned char[]> outbuf;
+    z_stream stream;
+    bool streamInitialized;
+    int streamLevel;
+    QByteArray pendingDict;     /* preset dictionary staged for the next prepare() */
+
+    NrCompressorContextPrivate()
+        : streamInitialized(false), streamLevel(-1)
+    {
+        memset(&stream, 0, sizeof(stream));
+    }
+
+    ~NrCompressorContextPrivate()
+    {
+        if (streamInitialized) {
+            deflateEnd(&stream);
+        }
+    }
+
+    int prepare(int i_level)
+    {
+        if (!inbuf) {
+            inbuf.reset(new unsigned char [GZIP_BUF_SIZE]);
+        }
+        if (!outbuf) {
+            outbuf.reset(new unsigned char [GZIP_BUF_SIZE]);
+        }
+
+        if (streamInitialized) {
+            if (i_level == streamLevel && deflateReset(&stream) == Z_OK) {
+                stream.next_in = nullptr;
+                stream.avail_in = 0;
+                stream.next_out = outbuf.get();
+                stream.avail_out = GZIP_BUF_SIZE;
+                return applyPendingDictionary();
+            }
+            //level changed (or the reset failed): rebuild the stream from scratch
+            deflateEnd(&stream);
+            streamInitialized = false;
+        }
+
+        memset(&stream, 0, sizeof(stream));
+        stream.next_out = outbuf.get();
+        stream.avail_out = GZIP_BUF_SIZE;
+
+        if (deflateInit2(&stream, i_level, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 9, MZ_DEFAULT_STRATEGY) != Z_OK) {
+            std::cerr << "deflateInit2() failed!" << std::endl;
+            return NrFileCompressor::E_MINIZ_ERROR;
+        }
+
+        streamInitialized = true;
+        streamLevel = i_level;
+        return applyPendingDictionary();
+    }
+
+    /* primes the freshly reset stream with the dictionary staged by the caller, if any */
+    int applyPendingDictionary()
+    {
+        if (pendingDict.isEmpty()) {
+            return Z_OK;
+        }
+        QByteArray dict = pendingDict;
+        pendingDict.clear(); //consumed: the next prepare() starts clean again
+        if (mz_deflateSetDictionary(&stream, (const unsigned char *)dict.constData(), (unsigned int)dict.size()) != Z_OK) {
+            std::cerr << "deflateSetDictionary() failed!" << std::endl;
+            invalidate();
+            return NrFileCompressor::E_MINIZ_ERROR;
+        }
+        return Z_OK;
+    }
+
+    /* drops the deflate state after a failed run (it is rebuilt on the next prepare) */
+    void invalidate()
+    {
+        if (streamInitialized) {
+            deflateEnd(&stream);
+            streamInitialized = false;
+        }
+    }
+};
+
+
+/*
+ * The context backing the static gzip API: one per thread, so repeated
+ * static calls from the same thread reuse buffers and deflate state without
+ * any locking.
+ */
+static NrCompressorContextPrivate& threadLocalGzipContext()
+{
+    static thread_local NrCompressorContextPrivate ctx;
+    return ctx;
+}
+
+
+/*
+ * Deflates a memory-mapped source region to the (already opened) destination
+ * file, updating the running crc. This is the zero-copy input path of
+ * compressGzipFileHooked(): deflate reads straight from the mapping (i.e. the
+ * page cache), so the only buffer used is the context output one.
+ */
+static int gzipDeflateMappedInput(NrCompressorContextPrivate &ctx, const uchar *i_src, qint64 i_size, QIODevice *o_out, int level, ulong &io_crc,
+                                  const NrFileCompressor::ProgressCallback &i_progressCb, const std::atomic<bool> *i_cancelToken,
+                                  NrFileCompressor::NrCompressionStats *o_stats = nullptr)
+{
+    const qint64 BUF_SIZE = GZIP_BUF_SIZE;
+
+    QElapsedTimer statTimer;
+    qint64 t0 = 0;
+    if (o_stats) {
+        statTimer.start();
+    }
+
+    if (ctx.prepare(level) != Z_OK)
+    {
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    unsigned char *s_outbuf = ctx.outbuf.get();
+    z_stream &stream = ctx.stream;
+
+    qint64 infile_remaining = i_size;
+    qint64 offset = 0;
+
+    for ( ; ; )
+    {
+        int status;
+        if (!stream.avail_in)
+        {
+            if (i_cancelToken && i_cancelToken->load())
+            {
+                ctx.invalidate();
+                return NrFileCompressor::E_OPERATION_CANCELED;
+            }
+
+            // Input buffer is empty: point the stream at the next mapped slice (no copy).
+            uint n = qMin((qint64)BUF_SIZE, infile_remaining);
+
+            if (o_stats) t0 = statTimer.nsecsElapsed();
+            io_crc = mz_crc32(io_crc, i_src + offset, n);
+            if (o_stats) o_stats->crcNsecs += statTimer.nsecsElapsed() - t0;
+
+            stream.next_in = i_src + offset;
+            stream.avail_in = n;
+
+            offset += n;
+            infile_remaining -= n;
+
+            if (i_progressCb)
+            {
+                i_progressCb(offset, i_size);
+            }
+        }
+
+        if (o_stats) t0 = statTimer.nsecsElapsed();
+        status = deflate(&stream, infile_remaining ? Z_NO_FLUSH : Z_FINISH);
+        if (o_stats) o_stats->deflateNsecs += statTimer.nsecsElapsed() - t0;
+
+        if ((status == Z_STREAM_END) || (!stream.avail_out))
+        {
+            uint n = BUF_SIZE - stream.avail_out;
+            if (o_stats) t0 = statTimer.nsecsElapsed();
+            bool wrOk = (o_out->write((char*)s_outbuf, n) == n);
+            if (o_stats) o_stats->writeNsecs += statTimer.nsecsElapsed() - t0;
+            if (!wrOk)
+            {
+                std::cerr << "Failed writing to output file!" << std::endl;
+                ctx.invalidate();
+                return NrFileCompressor::E_MINIZ_ERROR;
+            }
+            stream.next_out = s_outbuf;
+            stream.avail_out = BUF_SIZE;
+        }
+
+        if (status == Z_STREAM_END)
+            break;
+        else if (status != Z_OK)
+        {
+            std::cerr << "deflate() failed with status: " << status << std::endl;
+            ctx.invalidate();
+            return NrFileCompressor::E_MINIZ_ERROR;
+        }
+    }
+
+    //the stream stays initialized in the context for the next file (deflateReset)
+    return Z_OK;
+}
+
+
+/*
+ * The generic deflate loop: reads from any QIODevice (file, socket, buffer)
+ * in 1 MB chunks and writes the raw deflate stream to another device,
+ * updating the running crc and the total input byte count. End of input is
+ * detected via atEnd()/short reads, so it also works on devices whose size
+ * is not known upfront; i_totalHint (-1 when unknown) is only used for the
+ * progress callback.
+ */
+static int gzipDeflateDeviceInput(NrCompressorContextPrivate &ctx, QIODevice *i_in, QIODevice *o_out, int level, ulong &io_crc, qint64 &o_totalIn,
+                                  qint64 i_totalHint, const NrFileCompressor::ProgressCallback &i_progressCb,
+                                  const std::atomic<bool> *i_cancelToken,
+                                  NrFileCompressor::NrCompressionStats *o_stats = nullptr)
+{
+    const qint64 BUF_SIZE = GZIP_BUF_SIZE;
+
+    QElapsedTimer statTimer;
+    qint64 t0 = 0;
+    if (o_stats) {
+        statTimer.start();
+    }
+
+    if (ctx.prepare(level) != Z_OK)
+    {
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    unsigned char *s_inbuf = ctx.inbuf.get();
+    unsigned char *s_outbuf = ctx.outbuf.get();
+    z_stream &stream = ctx.stream;
+
+    o_totalIn = 0;
+    bool inputDone = false;
+
+    for ( ; ; )
+    {
+        int status;
+        if (!stream.avail_in && !inputDone)
+        {
+            if (i_cancelToken && i_cancelToken->load())
+            {
+                ctx.invalidate();
+                return NrFileCompressor::E_OPERATION_CANCELED;
+            }
+
+            // Input buffer is empty, so read more bytes from the input device.
+            if (o_stats) t0 = statTimer.nsecsElapsed();
+            qint64 n = i_in->read((char*)s_inbuf, BUF_SIZE);
+            if (o_stats) o_stats->readNsecs += statTimer.nsecsElapsed() - t0;
+            if (n < 0)
+            {
+                std::cerr << "Failed reading from input device!" << std::endl;
+                ctx.invalidate();
+                return NrFileCompressor::E_MINIZ_ERROR;
+            }
+
+            if (n > 0)
+            {
+                //update the crc
+                if (o_stats) t0 = statTimer.nsecsElapsed();
+                io_crc = mz_crc32(io_crc, s_inbuf, static_cast<size_t>(n));
+                if (o_stats) o_stats->crcNsecs += statTimer.nsecsElapsed() - t0;
+
+                stream.next_in = s_inbuf;
+                stream.avail_in = static_cast<unsigned int>(n);
+                o_totalIn += n;
+
+                if (i_progressCb)
+                {
+                    i_progressCb(o_totalIn, i_totalHint);
+                }
+            }
+
+            if (n == 0 || i_in->atEnd())
+            {
+                inputDone = true;
+            }
+        }
+
+        if (o_stats) t0 = statTimer.nsecsElapsed();
+        status = deflate(&stream, inputDone ? Z_FINISH : Z_NO_FLUSH);
+        if (o_stats) o_stats->deflateNsecs += statTimer.nsecsElapsed() - t0;
+
+        if ((status == Z_STREAM_END) || (!stream.avail_out))
+        {
+            // Output buffer is full, or compression is done, so write buffer to the output device.
+            uint n = BUF_SIZE - stream.avail_out;
+            if (o_stats) t0 = statTimer.nsecsElapsed();
+            bool wrOk = (o_out->write((char*)s_outbuf, n) == n);
+            if (o_stats) o_stats->writeNsecs += statTimer.nsecsElapsed() - t0;
+            if (!wrOk)
+            {
+                std::cerr << "Failed writing to output device!" << std::endl;
+                ctx.invalidate();
+                return NrFileCompressor::E_MINIZ_ERROR;
+            }
+            stream.next_out = s_outbuf;
+            stream.avail_out = BUF_SIZE;
+        }
+
+        if (status == Z_STREAM_END)
+            break;
+        else if (status != Z_OK)
+        {
+            std::cerr << "deflate() failed with status: " << status << std::endl;
+            ctx.invalidate();
+            return NrFileCompressor::E_MINIZ_ERROR;
+        }
+    }
+
+    //the stream stays initialized in the context for the next file (deflateReset)
+    return Z_OK;
+}
+
+
+namespace {
+
+/*
+ * Shared state of the pipelined gzip loop: two input and two output slots
+ * handed between the reader thread, the deflate stage (the calling thread)
+ * and the writer thread through counting semaphores. Double buffering is
+ * enough: each stage works on one slot while its neighbour fills/drains the
+ * other one.
+ */
+struct GzipPipeState
+{
+    QIODevice *in;
+    QIODevice *out;
+
+    QByteArray inBuf[2];
+    qint64 inLen[2];
+    QSemaphore inFree;
+    QSemaphore inFilled;
+
+    QByteArray outBuf[2];
+    qint64 outLen[2];               /* -1 is the writer shutdown sentinel */
+    QSemaphore outFree;
+    QSemaphore outFilled;
+
+    std::atomic<bool> readFailed;
+    std::atomic<bool> writeFailed;
+    std::atomic<bool> abort;        /* tells the reader to stop early */
+
+    GzipPipeState(QIODevice *i_in, QIODevice *o_out)
+        : in(i_in), out(o_out), inFree(2), inFilled(0), outFree(2), outFilled(0),
+          readFailed(false), writeFailed(false), abort(false)
+    {
+        for (int i = 0; i < 2; ++i) {
+            inBuf[i].resize(GZIP_BUF_SIZE);
+            outBuf[i].resize(GZIP_BUF_SIZE);
+            inLen[i] = 0;
+            outLen[i] = 0;
+        }
+    }
+};
+
+
+/* fills input slots ahead of the deflate stage; a zero-length slot marks end of input */
+class GzipPipeReader : public QRunnable
+{
+public:
+    GzipPipeReader(GzipPipeState *i_state) : m_state(i_state) { setAutoDelete(false); }
+
+    void run()
+    {
+        int slot = 0;
+        for ( ; ; ) {
+            m_state->inFree.acquire();
+            if (m_state->abort.load()) {
+                break;
+            }
+            qint64 n = m_state->in->read(m_state->inBuf[slot].data(), GZIP_BUF_SIZE);
+            if (n < 0) {
+                m_state->readFailed.store(true);
+                n = 0;
+            }
+            m_state->inLen[slot] = n;
+            m_state->inFilled.release();
+            if (n == 0) {
+                break;
+            }
+            slot ^= 1;
+        }
+    }
+
+private:
+    GzipPipeState *m_state;
+};
+
+
+/* drains output slots behind the deflate stage */
+class GzipPipeWriter : public QRunnable
+{
+public:
+    GzipPipeWriter(GzipPipeState *i_state) : m_state(i_state) { setAutoDelete(false); }
+
+    void run()
+    {
+        int slot = 0;
+        for ( ; ; ) {
+            m_state->outFilled.acquire();
+            qint64 n = m_state->outLen[slot];
+            if (n < 0) {
+                break;
+            }
+            if (n > 0 && !m_state->writeFailed.load()) {
+                if (m_state->out->write(m_state->outBuf[slot].constData(), n) != n) {
+                    m_state->writeFailed.store(true);
+                }
+            }
+            m_state->outFree.release();
+            slot ^= 1;
+        }
+    }
+
+private:
+    GzipPipeState *m_state;
+};
+
+} //anonymous namespace
+
+
+/*
+ * The pipelined variant of gzipDeflateDeviceInput(): a reader thread keeps
+ * the next input slot full and a writer thread drains finished output slots,
+ * so the disk works while deflate runs and vice versa. Same contract as the
+ * plain loop; the devices must not be touched by anybody else while it runs
+ * (each one is driven by exactly one pipeline thread).
+ */
+static int gzipDeflatePipelined(NrCompressorContextPrivate &ctx, QIODevice *i_in, QIODevice *o_out, int level, ulong &io_crc, qint64 &o_totalIn,
+                                qint64 i_totalHint, const NrFileCompressor::ProgressCallback &i_progressCb,
+                                const std::atomic<bool> *i_cancelToken,
+                                NrFileCompressor::NrCompressionStats *o_stats = nullptr)
+{
+    const qint64 BUF_SIZE = GZIP_BUF_SIZE;
+
+    QElapsedTimer statTimer;
+    qint64 t0 = 0;
+    if (o_stats) {
+        statTimer.start();
+    }
+
+    if (ctx.prepare(level) != Z_OK)
+    {
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    z_stream &stream = ctx.stream;
+
+    GzipPipeState state(i_in, o_out);
+    GzipPipeReader reader(&state);
+    GzipPipeWriter writer(&state);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(2);
+    pool.start(&reader);
+    pool.start(&writer);
+
+    o_totalIn = 0;
+    bool inputDone = false;
+    bool ownInSlot = false;         /* deflate still points into the current input slot */
+    int inSlot = 0;
+    int outSlot = 0;
+
+    //deflate writes straight into the writer's first slot
+    state.outFree.acquire();
+    bool ownOutSlot = true;
+    stream.next_out = (unsigned char *)state.outBuf[outSlot].data();
+    stream.avail_out = static_cast<unsigned int>(BUF_SIZE);
+
+    int ret = Z_OK;
+
+    for ( ; ; )
+    {
+        int status;
+        if (!stream.avail_in && !inputDone)
+        {
+            //the current slot is fully consumed: hand it back and take the next one
+            if (ownInSlot)
+            {
+                state.inFree.release();
+                inSlot ^= 1;
+            }
+
+            if (i_cancelToken && i_cancelToken->load())
+            {
+                ret = NrFileCompressor::E_OPERATION_CANCELED;
+                break;
+            }
+
+            //a failed tryAcquire means the reader is behind: that is an input
+            //stall, and the time spent blocked is charged to the read stage
+            if (o_stats) {
+                if (!state.inFilled.tryAcquire()) {
+                    ++o_stats->inputStalls;
+                    t0 = statTimer.nsecsElapsed();
+                    state.inFilled.acquire();
+                    o_stats->readNsecs += statTimer.nsecsElapsed() - t0;
+                }
+            } else {
+                state.inFilled.acquire();
+            }
+            ownInSlot = true;
+
+            if (state.readFailed.load())
+            {
+                std::cerr << "Failed reading from input device!" << std::endl;
+                ret = NrFileCompressor::E_MINIZ_ERROR;
+                break;
+            }
+
+            qint64 n = state.inLen[inSlot];
+            if (n > 0)
+            {
+                if (o_stats) t0 = statTimer.nsecsElapsed();
+                io_crc = mz_crc32(io_crc, (const unsigned char *)state.inBuf[inSlot].constData(), static_cast<size_t>(n));
+                if (o_stats) o_stats->crcNsecs += statTimer.nsecsElapsed() - t0;
+
+                stream.next_in = (const unsigned char *)state.inBuf[inSlot].constData();
+                stream.avail_in = static_cast<unsigned int>(n);
+                o_totalIn += n;
+
+                if (i_progressCb)
+                {
+                    i_progressCb(o_totalIn, i_totalHint);
+                }
+            }
+            else
+            {
+                inputDone = true;
+            }
+        }
+
+        if (o_stats) t0 = statTimer.nsecsElapsed();
+        status = deflate(&stream, inputDone ? Z_FINISH : Z_NO_FLUSH);
+        if (o_stats) o_stats->deflateNsecs += statTimer.nsecsElapsed() - t0;
+
+        if ((status == Z_STREAM_END) || (!stream.avail_out))
+        {
+            //the slot is full (or holds the final bytes): pass it to the writer
+            state.outLen[outSlot] = BUF_SIZE - stream.avail_out;
+            state.outFilled.release();
+            outSlot ^= 1;
+            ownOutSlot = false;
+
+            if (state.writeFailed.load())
+            {
+                std::cerr << "Failed writing to output device!" << std::endl;
+                ret = NrFileCompressor::E_MINIZ_ERROR;
+                break;
+            }
+
+            if (status != Z_STREAM_END)
+            {
+                //symmetric to the input side: waiting for a free slot means
+                //the writer is the bottleneck
+                if (o_stats) {
+                    if (!state.outFree.tryAcquire()) {
+                        ++o_stats->outputStalls;
+                        t0 = statTimer.nsecsElapsed();
+                        state.outFree.acquire();
+                        o_stats->writeNsecs += statTimer.nsecsElapsed() - t0;
+                    }
+                } else {
+                    state.outFree.acquire();
+                }
+                ownOutSlot = true;
+                stream.next_out = (unsigned char *)state.outBuf[outSlot].data();
+                stream.avail_out = static_cast<unsigned int>(BUF_SIZE);
+            }
+        }
+
+        if (status == Z_STREAM_END)
+            break;
+        else if (status != Z_OK)
+        {
+            std::cerr << "deflate() failed with status: " << status << std::endl;
+            ret = NrFileCompressor::E_MINIZ_ERROR;
+            break;
+        }
+    }
+
+    //writer shutdown: send the sentinel through a (possibly fresh) slot
+    if (!ownOutSlot)
+    {
+        state.outFree.acquire();
+    }
+    state.outLen[outSlot] = -1;
+    state.outFilled.release();
+
+    //reader shutdown: wake it if it is waiting for a free slot
+    state.abort.store(true);
+    state.inFree.release(2);
+
+    pool.waitForDone();
+
+    //the writer may have failed on the very last buffer
+    if (ret == Z_OK && state.writeFailed.load())
+    {
+        std::cerr << "Failed writing to output device!" << std::endl;
+        ret = NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    if (ret != Z_OK)
+    {
+        ctx.invalidate();
+        return ret;
+    }
+
+    //the stream stays initialized in the context for the next file (deflateReset)
+    return Z_OK;
+}
+
+
+/* builds the cache entry path for one (content, level) pair: the key is the
+   SHA-256 of the source bytes - a hit must mean byte-identical content, so
+   the key has to be collision-resistant, not merely cheap - with the level
+   appended, since the same bytes compress differently per level */
+static QString dedupCacheEntryPath(const QString &i_cacheDir, const QByteArray &i_contentHash, int i_level)
+{
+    return QString("%1/%2-l%3%4")
+            .arg(i_cacheDir)
+            .arg(QString(i_contentHash.toHex()))
+            .arg(i_level)
+            .arg(GZIP_EXT);
+}
+
+
+/* SHA-256 of the whole device content, read in gzip-loop-sized chunks; the
+   device is rewound afterwards */
+static QByteArray dedupCacheHashSource(QIODevice *i_in)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    std::unique_ptr<char[]> buf(new char[GZIP_BUF_SIZE]);
+    qint64 n;
+    while ((n = i_in->read(buf.get(), GZIP_BUF_SIZE)) > 0) {
+        hash.addData(buf.get(), static_cast<int>(n));
+    }
+    i_in->seek(0);
+    return hash.result();
+}
+
+
+/* materializes i_from as i_to: hardlink when the filesystem allows it (same
+   device, Unix), byte copy otherwise; any stale destination is replaced */
+static bool dedupCacheMaterialize(const QString &i_from, const QString &i_to)
+{
+    QFile::remove(i_to);
+#ifdef Q_OS_LINUX
+    if (::link(i_from.toLocal8Bit().constData(), i_to.toLocal8Bit().constData()) == 0) {
+        return true;
+    }
+#endif
+    return QFile::copy(i_from, i_to);
 }
 
 
-int NrFileCompressor::writeGzipHeader(QFile *pFile, quint32 i_mtime)
+/*!
+ * \brief NrFileCompressor::compressGzipFileHooked the gzip compression loop with optional progress and cancellation hooks
+ * \param i_filename the filename (without path) of the file to be compressed
+ * \param i_srcpath the path where the file to be compressed is located
+ * \param i_dstpath the path where the compressed file should be created (it must exists and be writable)
+ * \param level the level of compression to be used while compressing the GZIP file (0=storing, 6=default, 9=maximum)
+ * \param i_progressCb optional callback invoked with (processed, total) bytes after each input chunk
+ * \param i_cancelToken optional flag checked between chunks; when set the job aborts with E_OPERATION_CANCELED
+ * \return a integer return code, 0 meaning the process was successfull
+ */
+int NrFileCompressor::compressGzipFileHooked(const QString &i_filename, const QString &i_srcpath, const QString &i_dstpath, int level,
+                                             const ProgressCallback &i_progressCb, const std::atomic<bool> *i_cancelToken,
+                                             const CompressorOptions *i_ioOptions,
+                                             NrCompressorContextPrivate *i_ctx)
 {
-    /*
-        It builds the GZIP file structure with his header and footer in this format:
-        (http://www.zlib.org/rfc-gzip.html)
+    //use the caller supplied context when there is one, the per-thread one otherwise
+    NrCompressorContextPrivate &ctx = i_ctx ? *i_ctx : threadLocalGzipContext();
 
-        +---+---+---+---+---+---+---+---+---+---+=============================+---+---+---+---+---+---+---+---+
-        |ID1|ID2|CM |FLG|     MTIME     |XFL|OS |   ....COMPRESSED DATA....   |     CRC32     |     ISIZE     |
-        +---+---+---+---+---+---+---+---+---+---+=============================+---+---+---+---+---+---+---+---+
+    //stage the preset dictionary (if any) for the prepare() inside the deflate loop
+    ctx.pendingDict = i_ioOptions ? i_ioOptions->presetDictionary : QByteArray();
 
-        The first 10 bytes header is fixed, the CRC32 is the checksum of uncompressed data
-        and the ISIZE is the size of uncompressed data in bytes.
-     */
-    const char id1      = 31;   //Fixed value identifying GZip
-    const char  id2     = 139;  //Fixed value identifying GZip
-    const char  cm      = 8;    //(Fixed value identifying GZip) is the standard deflate method
-    const char  flg     = 0;    //0 means no extra flags
-    quint8 mtime[4];
-    const char  xflg    = 0;    //0 means no extra flags
+    NrCompressionStats *stats = i_ioOptions ? i_ioOptions->stats : nullptr;
+    if (stats) {
+        stats->reset();
+    }
 
-#ifdef WIN32
-    const char  os      = 0;    //0 is Dos/win, 3 is Unix-style (used for line endings)
+    QString compressedfilename = getCompressedFilename(i_filename, NrFileCompressor::GZIP_ARCHIVE);
+    QString destfilename = calculateFilenameWithPath(i_dstpath, compressedfilename);
+    QString srcfilename = calculateFilenameWithPath(i_srcpath, i_filename);
+
+    if (!QFile::exists(srcfilename)) {
+        std::cerr << "Cannot find file to compress: " << srcfilename.toStdString() << std::endl;
+        return NrFileCompressor::E_FILE_NOT_OPEN;
+    }
+
+    const bool dropCache = i_ioOptions && i_ioOptions->dropCacheHint;
+
+    QFile fin(srcfilename);
+    if (!fin.open(QIODevice::ReadOnly)) {
+        return NrFileCompressor::E_FILE_NOT_OPEN;
+    }
+
+    //pick the output sink according to the requested policy
+    QFile fout(destfilename);
+    QIODevice *out = nullptr;
+#ifdef Q_OS_LINUX
+    DirectWriteDevice directOut(destfilename, i_ioOptions ? i_ioOptions->writeBufferSize : 0);
+    const bool wantDirect = i_ioOptions && i_ioOptions->outputPolicy == NrFileCompressor::DIRECT_OUTPUT;
+    if (wantDirect && directOut.openDirect()) {
+        out = &directOut;
+    }
+#endif
+    if (!out) {
+        if (!fout.open(QIODevice::WriteOnly)) {
+            fin.close();
+            return NrFileCompressor::E_FILE_NOT_OPEN;
+        }
+        out = &fout;
+    }
+
+    if (level == NrFileCompressor::ADAPTIVE_COMPRESSION_LEVEL) {
+        level = resolveAdaptiveLevel(&fin);
+    }
+
+    //dedup cache: byte-identical sources already compressed at this level
+    //are served from the cache instead of being recompressed. The hit path
+    //reuses the cached artifact verbatim (including its embedded mtime).
+    const bool dedup = i_ioOptions && !i_ioOptions->dedupCacheDir.isEmpty();
+    QString cacheEntryPath;
+    if (dedup) {
+        QByteArray srcHash = dedupCacheHashSource(&fin);
+        cacheEntryPath = dedupCacheEntryPath(i_ioOptions->dedupCacheDir, srcHash, level);
+        if (QFile::exists(cacheEntryPath)) {
+            fin.close();
+            out->close();
+            if (!dedupCacheMaterialize(cacheEntryPath, destfilename)) {
+                std::cerr << "Cannot materialize cached artifact " << cacheEntryPath.toStdString() << std::endl;
+                return NrFileCompressor::E_FILE_NOT_WRITEABLE;
+            }
+            if (i_ioOptions->stats) {
+                i_ioOptions->stats->bytesIn = QFileInfo(srcfilename).size();
+                i_ioOptions->stats->bytesOut = QFileInfo(destfilename).size();
+            }
+            return Z_OK;
+        }
+    }
+
+    //write the GZip file header
+    QFileInfo finfo(fin);
+    writeGzipHeader(out, static_cast<quint32>(finfo.lastModified().toMSecsSinceEpoch()/1000));
+
+    // Compression.
+    qint64 finSize = fin.size();
+
+    int res = Z_OK;
+    ulong crc = mz_crc32(0, nullptr, 0);
+
+    // Zero-copy fast path: feed deflate straight from a memory mapping of the
+    // source when the OS grants one; pipelinedIo opts out of it, since a cold
+    // mapping stalls deflate on every page fault while explicit reads can be
+    // overlapped. Whenever the mapping is skipped or refused, the pipelined
+    // loop keeps reads, deflate and writes running concurrently.
+    const bool pipelined = i_ioOptions && i_ioOptions->pipelinedIo;
+    const uchar *mapped = (!pipelined && finSize > 0) ? fin.map(0, finSize) : nullptr;
+    if (mapped) {
+        res = gzipDeflateMappedInput(ctx, mapped, finSize, out, level, crc, i_progressCb, i_cancelToken, stats);
+        fin.unmap(const_cast<uchar*>(mapped));
+    } else {
+        qint64 totalIn = 0;
+        res = gzipDeflatePipelined(ctx, &fin, out, level, crc, totalIn, finSize, i_progressCb, i_cancelToken, stats);
+    }
+
+    if (res != Z_OK) {
+        if (res == NrFileCompressor::E_OPERATION_CANCELED) {
+            std::cerr << "Compression of " << i_filename.toStdString() << " canceled" << std::endl;
+        }
+        fin.close();
+        out->close();
+        return res;
+    }
+
+    //This is a fast modulo to power-of-2 numbers
+    quint32 modsize = static_cast<quint32>(finSize & (LONG_MAX - 1));
+    //write the GZIP file footer
+    writeGzipFooter(out, static_cast<quint32>(crc), modsize);
+
+#ifdef Q_OS_LINUX
+    if (out == &fout && dropCache) {
+        //flushing first so the advice covers the freshly written (dirty) pages too
+        ::fdatasync(fout.handle());
+        posix_fadvise(fout.handle(), 0, 0, POSIX_FADV_DONTNEED);
+    }
+    if (dropCache) {
+        posix_fadvise(fin.handle(), 0, 0, POSIX_FADV_DONTNEED);
+    }
+    if (out == &directOut && !directOut.finish(dropCache)) {
+        fin.close();
+        out->close();
+        return NrFileCompressor::E_FILE_NOT_WRITEABLE;
+    }
 #else
-    const char  os      = 3;    //0 is Dos/win, 3 is Unix-style (used for line endings)
+    (void)dropCache;
 #endif
 
-    mtime[0] = getByte(i_mtime, 0);
-    mtime[1] = getByte(i_mtime, 1);
-    mtime[2] = getByte(i_mtime, 2);
-    mtime[3] = getByte(i_mtime, 3);
+    fin.close();
+    out->close();
+
+    //dedup cache miss: publish the fresh artifact for the next identical source
+    if (dedup && !QFile::exists(cacheEntryPath)) {
+        QDir().mkpath(i_ioOptions->dedupCacheDir);
+        if (!dedupCacheMaterialize(destfilename, cacheEntryPath)) {
+            //a failed cache insert costs only future hits, not this job
+            std::cerr << "Cannot store artifact in dedup cache: " << cacheEntryPath.toStdString() << std::endl;
+        }
+    }
 
+    if (stats) {
+        stats->bytesIn = finSize;
+        stats->bytesOut = QFileInfo(destfilename).size();
+    }
 
-    pFile->write(&id1, 1);
-    pFile->write(&id2, 1);
-    pFile->write(&cm, 1);
-    pFile->write(&flg, 1);
-    pFile->write((const char*) &mtime, 4);
-    pFile->write(&xflg, 1);
-    pFile->write(&os, 1);
+    return Z_OK;
+}
 
-    return 0;
+
+/*!
+ * \brief NrFileCompressor::compressGzipStream compresses everything readable from a QIODevice into another QIODevice as a gzip stream
+ * \param in the source device, already opened for reading (file, socket, QBuffer, ...)
+ * \param out the destination device, already opened for writing; receives a complete .gz stream (header, deflate data, footer)
+ * \param level the level of compression to be used (0=storing, 6=default, 9=maximum)
+ * \param mtime the modification time (seconds since the epoch) to store in the gzip header, 0 if not meaningful
+ * \return a integer return code, 0 meaning the process was successfull
+ *
+ * This is the no-temp-file path: data coming from a socket or an in-memory
+ * buffer is compressed on the fly, without being spilled to disk first.
+ * Input is consumed until the device reports end of data (atEnd() or a
+ * zero-length read), so the source size does not need to be known upfront.
+ */
+int NrFileCompressor::compressGzipStream(QIODevice *in, QIODevice *out, int level, quint32 mtime)
+{
+    return compressGzipStreamCtx(in, out, level, mtime, nullptr);
 }
 
 
-int NrFileCompressor::writeGzipFooter(QFile *pFile, quint32 i_crc32, quint32 i_size)
+/*!
+ * \brief NrFileCompressor::compressGzipBuffer compresses an in-memory payload into a gzip stream, no file I/O involved
+ * \param in the payload to compress
+ * \param out the QByteArray that will receive the complete gzip stream (its previous content is discarded)
+ * \param level the level of compression to be used (0=storing, 6=default, 9=maximum)
+ * \return 0 if successful, a negative error code otherwise
+ */
+int NrFileCompressor::compressGzipBuffer(const QByteArray &in, QByteArray &out, int level)
 {
-    quint8 size[4];
-    size[0] = getByte(i_size, 0);
-    size[1] = getByte(i_size, 1);
-    size[2] = getByte(i_size, 2);
-    size[3] = getByte(i_size, 3);
+    QBuffer inBuf;
+    inBuf.setData(in);
+    if (!inBuf.open(QIODevice::ReadOnly)) {
+        return NrFileCompressor::E_FILE_NOT_OPEN;
+    }
 
-    quint8 crc32[4];
-    crc32[0] = getByte(i_crc32, 0);
-    crc32[1] = getByte(i_crc32, 1);
-    crc32[2] = getByte(i_crc32, 2);
-    crc32[3] = getByte(i_crc32, 3);
+    out.clear();
+    QBuffer outBuf(&out);
+    if (!outBuf.open(QIODevice::WriteOnly)) {
+        return NrFileCompressor::E_FILE_NOT_WRITEABLE;
+    }
 
-    pFile->write((const char*) &crc32, 4);
-    pFile->write((const char*) &size, 4);
+    return compressGzipStreamCtx(&inBuf, &outBuf, level, 0, nullptr);
+}
 
-    return 0;
+
+/*!
+ * \brief NrFileCompressor::trainCompressionDictionary builds a preset dictionary out of sample files
+ * \param sampleFiles paths of files representative of the corpus to be compressed (e.g. a handful of rotated logs)
+ * \param maxSize the dictionary size cap; deflate can only reference the last 32 KB, so larger values are wasted
+ * \return the dictionary, to be placed in CompressorOptions::presetDictionary (empty when no sample could be read)
+ *
+ * This is a deliberately simple trainer: it interleaves equal slices of every
+ * sample so the shared boilerplate of near-identical files ends up inside the
+ * deflate window. It does not do suffix analysis like a dedicated tool would,
+ * but on batches of look-alike small files it already captures most of the
+ * cross-file redundancy.
+ */
+QByteArray NrFileCompressor::trainCompressionDictionary(const QStringList &sampleFiles, int maxSize)
+{
+    QByteArray dict;
+    if (sampleFiles.isEmpty() || maxSize <= 0) {
+        return dict;
+    }
+
+    const int sliceSize = qMax(256, maxSize / qMax(1, sampleFiles.size()));
+
+    for (int i = 0; i < sampleFiles.size() && dict.size() < maxSize; ++i) {
+        QFile f(sampleFiles.at(i));
+        if (!f.open(QIODevice::ReadOnly)) {
+            std::cerr << "Cannot read dictionary sample: " << sampleFiles.at(i).toStdString() << std::endl;
+            continue;
+        }
+        dict.append(f.read(qMin<qint64>(sliceSize, maxSize - dict.size())));
+    }
+
+    return dict;
+}
+
+
+/* the compressGzipStream body, parametrized on the working context */
+int NrFileCompressor::compressGzipStreamCtx(QIODevice *in, QIODevice *out, int level, quint32 mtime,
+                                            NrCompressorContextPrivate *i_ctx)
+{
+    NrCompressorContextPrivate &ctx = i_ctx ? *i_ctx : threadLocalGzipContext();
+
+    if (in == nullptr || !in->isOpen() || !in->isReadable()) {
+        std::cerr << "Input device is not open for reading!" << std::endl;
+        return NrFileCompressor::E_FILE_NOT_OPEN;
+    }
+    if (out == nullptr || !out->isOpen() || !out->isWritable()) {
+        std::cerr << "Output device is not open for writing!" << std::endl;
+        return NrFileCompressor::E_FILE_NOT_WRITEABLE;
+    }
+
+    if (level == NrFileCompressor::ADAPTIVE_COMPRESSION_LEVEL) {
+        level = resolveAdaptiveLevel(in);
+    }
+
+    writeGzipHeader(out, mtime);
+
+    ulong crc = mz_crc32(0, nullptr, 0);
+    qint64 totalIn = 0;
+
+    int res = gzipDeflateDeviceInput(ctx, in, out, level, crc, totalIn, -1, ProgressCallback(), nullptr);
+    if (res != Z_OK) {
+        return res;
+    }
+
+    //ISIZE is the uncompressed size modulo 2^32
+    writeGzipFooter(out, static_cast<quint32>(crc), static_cast<quint32>(totalIn));
+
+    return Z_OK;
 }
 
 
+/***************************
+ *   PARALLEL gZIP PART    *
+ * *************************/
+
+namespace {
+
+//size of the input blocks handed to the worker threads
+const qint64 PARALLEL_GZIP_CHUNK_SIZE = (4 * 1024 * 1024);
+
+/*
+ * One input block of the file being compressed in parallel.
+ * The main thread fills \c in, a worker deflates it into \c out and
+ * releases \c done, then the main thread writes \c out to the destination
+ * file in the original block order.
+ */
+struct GzipChunkJob
+{
+    std::unique_ptr<unsigned char[]> in;
+    std::unique_ptr<unsigned char[]> out;
+    qint64 inSize;
+    qint64 outSize;
+    int level;
+    bool isLast;
+    int status;
+    QSemaphore done;
+
+    GzipChunkJob()
+        : inSize(0), outSize(0), level(MZ_DEFAULT_LEVEL), isLast(false), status(Z_OK)
+    { /* empty */ }
+};
+
+
+/*
+ * Deflates a single chunk as an independent piece of a raw deflate stream.
+ * Every chunk but the last is terminated with Z_FULL_FLUSH, which byte-aligns
+ * the output and resets the dictionary, so the concatenation of all the chunk
+ * outputs (the last one closed with Z_FINISH) is still one valid deflate
+ * stream that any gzip decoder accepts.
+ */
+class GzipChunkRunnable : public QRunnable
+{
+public:
+    explicit GzipChunkRunnable(GzipChunkJob *i_job)
+        : m_job(i_job)
+    {
+        setAutoDelete(true);
+    }
+
+    void run()
+    {
+        pinWorkerThreadToNumaNode();
+
+        GzipChunkJob *job = m_job;
+
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+
+        if (deflateInit2(&stream, job->level, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 9, MZ_DEFAULT_STRATEGY) != Z_OK) {
+            job->status = Z_STREAM_ERROR;
+            job->done.release();
+            return;
+        }
+
+        //worst-case output size for this chunk (plus room for the flush marker)
+        qint64 outCap = static_cast<qint64>(mz_deflateBound(&stream, static_cast<mz_ulong>(job->inSize))) + 16;
+        job->out.reset(new unsigned char[outCap]);
+
+        stream.next_in = job->in.get();
+        stream.avail_in = static_cast<unsigned int>(job->inSize);
+        stream.next_out = job->out.get();
+        stream.avail_out = static_cast<unsigned int>(outCap);
+
+        int flush = job->isLast ? Z_FINISH : Z_FULL_FLUSH;
+        int status = deflate(&stream, flush);
+
+        if ((job->isLast && status != Z_STREAM_END) || (!job->isLast && status != Z_OK)) {
+            job->status = (status < 0) ? status : Z_STREAM_ERROR;
+        } else {
+            job->outSize = outCap - stream.avail_out;
+            job->status = Z_OK;
+        }
+
+        deflateEnd(&stream);
+        job->done.release();
+    }
+
+private:
+    GzipChunkJob *m_job;
+};
+
+} //anonymous namespace
+
+
 /*!
- * \brief NrFileCompressor::compressGzipFile
+ * \brief NrFileCompressor::compressGzipFileParallel compresses a file to GZIP splitting the work across multiple threads (pigz-style)
  * \param i_filename the filename (without path) of the file to be compressed
  * \param i_srcpath the path where the file to be compressed is located
  * \param i_dstpath the path where the compressed file should be created (it must exists and be writable)
  * \param level the level of compression to be used while compressing the GZIP file (0=storing, 6=default, 9=maximum)
+ * \param i_threadCount the number of worker threads to use (0 = one per available core)
  * \return a integer return code, 0 meaning the process was successfull
+ *
+ * The input file is split into independent blocks that are deflated concurrently
+ * by a worker pool; each block is closed with a full flush so the blocks can be
+ * concatenated back into a single valid deflate stream. The output is a regular
+ * single-member .gz file, identical in format to the one produced by
+ * compressGzipFile() (only the block boundaries differ).
  */
-int NrFileCompressor::compressGzipFile(const QString &i_filename, const QString &i_srcpath, const QString &i_dstpath, int level)
+int NrFileCompressor::compressGzipFileParallel(const QString &i_filename, const QString &i_srcpath, const QString &i_dstpath, int level, int i_threadCount)
 {
-    std::cout << "Compressing (GZIP) file " << i_filename.toStdString() << std::endl;
-    //int level = Z_BEST_COMPRESSION;
-    z_stream stream;
-
     QString compressedfilename = getCompressedFilename(i_filename, NrFileCompressor::GZIP_ARCHIVE);
     QString destfilename = calculateFilenameWithPath(i_dstpath, compressedfilename);
     QString srcfilename = calculateFilenameWithPath(i_srcpath, i_filename);
@@ -367,31 +3262,10 @@ int NrFileCompressor::compressGzipFile(const QString &i_filename, const QString
         return NrFileCompressor::E_FILE_NOT_OPEN;
     }
 
-    const qint64 BUF_SIZE = (1024 * 1024);
-
-    ///////////////////////////////////////////////////////////////////
-    ///
-    /// We need to create those buffers in the heap, cause in Visual
-    /// Studio the stack memory is limited to 1MB and the following
-    /// instructions:
-    /// quint8 s_inbuf[BUF_SIZE];
-    /// quint8 s_outbuf[BUF_SIZE];
-    /// make the gzip compression crash at runtime
-
-    std::unique_ptr<unsigned char[]> s_inbuf(new unsigned char [BUF_SIZE]);
-    std::unique_ptr<unsigned char[]> s_outbuf(new unsigned char [BUF_SIZE]);
-
-    ///
-    ///
-    ///
-    ///////////////////////////////////////////////////////////////////
-
-    // Init the z_stream
-    memset(&stream, 0, sizeof(stream));
-    stream.next_in = s_inbuf.get();
-    stream.avail_in = 0;
-    stream.next_out = s_outbuf.get();
-    stream.avail_out = BUF_SIZE;
+    int threadCount = (i_threadCount > 0) ? i_threadCount : QThread::idealThreadCount();
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
 
     QFile fin(srcfilename);
     QFile fout(destfilename);
@@ -400,89 +3274,110 @@ int NrFileCompressor::compressGzipFile(const QString &i_filename, const QString
     b &= fin.open(QIODevice::ReadOnly);
     b &= fout.open(QIODevice::WriteOnly);
 
-    if(!b) {
+    if (!b) {
         fin.close();
         fout.close();
         return NrFileCompressor::E_FILE_NOT_OPEN;
     }
 
+    if (level == NrFileCompressor::ADAPTIVE_COMPRESSION_LEVEL) {
+        level = resolveAdaptiveLevel(&fin);
+    }
+
     //write the GZip file header
     QFileInfo finfo(fin);
     writeGzipHeader(&fout, static_cast<quint32>(finfo.lastModified().toMSecsSinceEpoch()/1000));
 
-    // Compression.
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+
     qint64 finSize = fin.size();
     qint64 infile_remaining = finSize;
 
-    //if (deflateInit(&stream, level) != Z_OK)
-    if (deflateInit2(&stream, level, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 9, MZ_DEFAULT_STRATEGY) != Z_OK)
-    {
-        std::cerr << "deflateInit2() failed!" << std::endl;
-        return NrFileCompressor::E_MINIZ_ERROR;
-    }
+    //bound the number of chunks in flight so memory stays at a few chunks per worker
+    const int maxInFlight = threadCount * 3;
+
+    std::vector< std::unique_ptr<GzipChunkJob> > jobs;
+    size_t nextToWrite = 0;
 
     //init the crc for uncompressed data
     ulong crc = mz_crc32(0, nullptr, 0);
 
-    //reading loop
-    for ( ; ; )
-    {
-        int status;
-        if (!stream.avail_in)
-        {
-          // Input buffer is empty, so read more bytes from input file.
-          uint n = qMin((qint64)BUF_SIZE, infile_remaining);
-
-          if (fin.read((char*)s_inbuf.get(), n) != n)
-          {
-            std::cerr << "Failed reading from input file!" << std::endl;
-            return NrFileCompressor::E_MINIZ_ERROR;
-          }
+    int ret = Z_OK;
 
-          //update the crc
-          crc = mz_crc32(crc, s_inbuf.get(), n);
+    do {
+        qint64 n = qMin(PARALLEL_GZIP_CHUNK_SIZE, infile_remaining);
 
-          stream.next_in = s_inbuf.get();
-          stream.avail_in = n;
+        std::unique_ptr<GzipChunkJob> job(new GzipChunkJob);
+        job->in.reset(new unsigned char[n > 0 ? n : 1]);
+        job->inSize = n;
+        job->level = level;
+        job->isLast = (n == infile_remaining);
 
-          infile_remaining -= n;
-          std::cout << "Input bytes remaining: " << infile_remaining << std::endl;
+        if (n > 0 && fin.read(reinterpret_cast<char*>(job->in.get()), n) != n) {
+            std::cerr << "Failed reading from input file!" << std::endl;
+            ret = NrFileCompressor::E_MINIZ_ERROR;
+            break;
         }
 
-        status = deflate(&stream, infile_remaining ? Z_NO_FLUSH : Z_FINISH);
-
-        if ((status == Z_STREAM_END) || (!stream.avail_out))
-        {
-          // Output buffer is full, or compression is done, so write buffer to output file.
-          uint n = BUF_SIZE - stream.avail_out;
-          if (fout.write((char*)s_outbuf.get(), n) != n)
-          {
-            std::cerr << "Failed writing to output file!" << std::endl;
-            return NrFileCompressor::E_MINIZ_ERROR;
-          }
-          stream.next_out = s_outbuf.get();
-          stream.avail_out = BUF_SIZE;
+        //update the crc (the blocks are read in order, so this stays sequential)
+        crc = mz_crc32(crc, job->in.get(), static_cast<size_t>(n));
+        infile_remaining -= n;
+
+        jobs.push_back(std::move(job));
+        pool.start(new GzipChunkRunnable(jobs.back().get()));
+
+        //write out completed chunks (in order) once enough work is in flight
+        while (jobs.size() - nextToWrite >= static_cast<size_t>(maxInFlight)) {
+            GzipChunkJob *w = jobs[nextToWrite].get();
+            w->done.acquire();
+            if (w->status != Z_OK) {
+                std::cerr << "deflate() failed on a parallel chunk with status: " << w->status << std::endl;
+                ret = NrFileCompressor::E_MINIZ_ERROR;
+            }
+            else if (fout.write(reinterpret_cast<char*>(w->out.get()), w->outSize) != w->outSize) {
+                std::cerr << "Failed writing to output file!" << std::endl;
+                ret = NrFileCompressor::E_MINIZ_ERROR;
+            }
+            //release the chunk buffers as soon as they have been written
+            jobs[nextToWrite].reset();
+            ++nextToWrite;
         }
-
-        if (status == Z_STREAM_END)
+        if (ret != Z_OK) {
             break;
-        else if (status != Z_OK)
-        {
-            std::cerr << "deflate() failed with status: " << status << std::endl;
-            return NrFileCompressor::E_MINIZ_ERROR;
         }
+    } while (infile_remaining > 0);
+
+    //drain the remaining chunks in order
+    for ( ; nextToWrite < jobs.size(); ++nextToWrite) {
+        GzipChunkJob *w = jobs[nextToWrite].get();
+        w->done.acquire();
+        if (ret != Z_OK) {
+            continue; //still need to wait for every worker before tearing down
+        }
+        if (w->status != Z_OK) {
+            std::cerr << "deflate() failed on a parallel chunk with status: " << w->status << std::endl;
+            ret = NrFileCompressor::E_MINIZ_ERROR;
+            continue;
+        }
+        if (fout.write(reinterpret_cast<char*>(w->out.get()), w->outSize) != w->outSize) {
+            std::cerr << "Failed writing to output file!" << std::endl;
+            ret = NrFileCompressor::E_MINIZ_ERROR;
+            continue;
+        }
+        jobs[nextToWrite].reset();
     }
 
-    if (deflateEnd(&stream) != Z_OK)
-    {
-        std::cerr << "deflateEnd() failed!" << std::endl;
-        return NrFileCompressor::E_MINIZ_ERROR;
+    pool.waitForDone();
+
+    if (ret != Z_OK) {
+        fin.close();
+        fout.close();
+        return ret;
     }
 
-    //This is a fast modulo to power-of-2 numbers
-    quint32 modsize = static_cast<quint32>(finSize & (LONG_MAX - 1));
-    //write the GZIP file footer
-    writeGzipFooter(&fout, static_cast<quint32>(crc), modsize);
+    //write the GZIP file footer (ISIZE is the uncompressed size modulo 2^32)
+    writeGzipFooter(&fout, static_cast<quint32>(crc), static_cast<quint32>(finSize));
 
     fin.close();
     fout.close();
@@ -491,5 +3386,51 @@ int NrFileCompressor::compressGzipFile(const QString &i_filename, const QString
 }
 
 
+/*************************************
+ *   REUSABLE COMPRESSION CONTEXT    *
+ * ***********************************/
+
+NrCompressorContext::NrCompressorContext()
+    : d(new NrCompressorContextPrivate)
+{
+    /* empty ctor: buffers and deflate state are built lazily on first use */
+}
+
+
+NrCompressorContext::~NrCompressorContext()
+{
+    delete d;
+}
+
+
+/*!
+ * \brief NrCompressorContext::compressGzipFile same as NrFileCompressor::compressGzipFile but reusing this context's buffers and deflate state
+ * \param filename the filename (without path) of the file to be compressed
+ * \param srcpath the path where the file to be compressed is located
+ * \param dstpath the path where the compressed file should be created (it must exists and be writable)
+ * \param level the level of compression to be used while compressing the GZIP file (0=storing, 6=default, 9=maximum)
+ * \return a integer return code, 0 meaning the process was successfull
+ */
+int NrCompressorContext::compressGzipFile(const QString &filename, const QString &srcpath, const QString &dstpath, int level)
+{
+    return NrFileCompressor::compressGzipFileHooked(filename, srcpath, dstpath, level,
+                                                    NrFileCompressor::ProgressCallback(), nullptr, nullptr, d);
+}
+
+
+/*!
+ * \brief NrCompressorContext::compressGzipStream same as NrFileCompressor::compressGzipStream but reusing this context's buffers and deflate state
+ * \param in the source device, already opened for reading
+ * \param out the destination device, already opened for writing
+ * \param level the level of compression to be used (0=storing, 6=default, 9=maximum)
+ * \param mtime the modification time (seconds since the epoch) to store in the gzip header, 0 if not meaningful
+ * \return a integer return code, 0 meaning the process was successfull
+ */
+int NrCompressorContext::compressGzipStream(QIODevice *in, QIODevice *out, int level, quint32 mtime)
+{
+    return NrFileCompressor::compressGzipStreamCtx(in, out, level, mtime, d);
+}
+
+
 END_NRFILECOMPRESSOR_NAMESPACE
 
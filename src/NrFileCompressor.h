@@ -7,8 +7,15 @@
 #ifndef NRFILECOMPRESSOR_H
 #define NRFILECOMPRESSOR_H
 
+#include <QList>
 #include <QString>
+#include <QStringList>
+
+#include <atomic>
+#include <functional>
+
 class QFile;
+class QIODevice;
 
 
 #ifdef USE_NRFILECOMPRESSOR_NAMESPACE
@@ -24,6 +31,31 @@ class QFile;
 
 BEGIN_NRFILECOMPRESSOR_NAMESPACE
 
+struct NrCompressorContextPrivate;
+
+/*!
+ * \brief The NrCompressionBackend class is the interface a pluggable
+ *        compression engine implements to serve fileCompress() calls.
+ *
+ * The built-in GZIP_ARCHIVE/ZIP_ARCHIVE formats are backed by miniz and
+ * need no backend; registering one (see
+ * NrFileCompressor::registerBackend()) lets an external codec (e.g. a
+ * zstd engine) slot in behind the same entry points, chosen per call via
+ * the algo parameter.
+ */
+class NrCompressionBackend
+{
+public:
+    virtual ~NrCompressionBackend();
+
+    /*! \return the extension (including the leading dot) appended to compressed filenames, e.g. ".zst" */
+    virtual QString fileExtension() const = 0;
+
+    /*! \return 0 if successful, a negative error code otherwise (same codes as NrFileCompressor::fileCompress()) */
+    virtual int compressFile(const QString &filename, const QString &srcpath, const QString &dstpath, int level) = 0;
+};
+
+
 class NrFileCompressor
 {
 
@@ -32,19 +64,115 @@ public:
     {
         NO_COMPRESSION,
         GZIP_ARCHIVE,
-        ZIP_ARCHIVE
+        ZIP_ARCHIVE,
+        ZSTD_ARCHIVE    /*!< served by a registered backend, there is no built-in zstd codec */
     };
 
+    /*! pass as the level argument to let the library probe the data and pick
+        a level itself: store-or-fast for incompressible input, the regular
+        default otherwise */
+    static const int ADAPTIVE_COMPRESSION_LEVEL = -1;
+
     enum CompressErrorType {
         E_FILE_NOT_OPEN         =  -1,
         E_FILE_NOT_WRITEABLE    =  -2,
         E_MINIZ_ERROR           =  -3,
+        E_OPERATION_CANCELED    =  -4,
+        E_NO_BACKEND            =  -5,
+    };
+
+    /* Callback reporting (processed bytes, total bytes) while a job runs */
+    typedef std::function<void(qint64, qint64)> ProgressCallback;
+
+    enum OutputPolicyType {
+        BUFFERED_OUTPUT = 0,    /*!< regular writes through the page cache (the default) */
+        DIRECT_OUTPUT   = 1     /*!< O_DIRECT page-aligned writes bypassing the page cache; Linux only, silently falls back to buffered elsewhere or when the filesystem refuses it */
+    };
+
+    /*!
+     * Per-job performance counters, filled when CompressorOptions::stats
+     * points at an instance. The gzip file path times each stage of its
+     * loop (source read, CRC update, deflate, destination write) with a
+     * monotonic clock, so a slow job can be attributed to I/O or CPU at a
+     * glance; the counters are cheap enough to leave on in production.
+     * The zip path fills only the byte counts (miniz drives its own I/O).
+     */
+    struct NrCompressionStats {
+        qint64 bytesIn;             /*!< uncompressed bytes consumed */
+        qint64 bytesOut;            /*!< compressed bytes produced (headers and footers included) */
+        qint64 readNsecs;           /*!< time spent reading the source (pipelined: time the deflate stage waited for input) */
+        qint64 crcNsecs;            /*!< time spent in mz_crc32() */
+        qint64 deflateNsecs;        /*!< time spent in deflate() proper */
+        qint64 writeNsecs;          /*!< time spent writing the destination (pipelined: time the deflate stage waited for a free output slot) */
+        qint64 inputStalls;         /*!< pipelined only: how often deflate found no input slot ready (reader is the bottleneck) */
+        qint64 outputStalls;        /*!< pipelined only: how often deflate found no output slot free (writer is the bottleneck) */
+
+        NrCompressionStats() { reset(); }
+
+        void reset()
+        {
+            bytesIn = bytesOut = 0;
+            readNsecs = crcNsecs = deflateNsecs = writeNsecs = 0;
+            inputStalls = outputStalls = 0;
+        }
+
+        /*! \return achieved compression ratio (bytesOut / bytesIn), 0 when nothing was consumed */
+        double ratio() const { return bytesIn > 0 ? (double)bytesOut / (double)bytesIn : 0.0; }
+    };
+
+    /*! options controlling progress reporting, cancellation and output I/O of a running job */
+    struct CompressorOptions {
+        ProgressCallback progressCallback;      /*!< invoked with (processed, total); total is -1 when not known upfront */
+        qint64 progressGranularity;             /*!< minimum progress delta (bytes or entries) between two callbacks */
+        const std::atomic<bool> *cancelToken;   /*!< checked between chunks/entries; when true the job aborts with E_OPERATION_CANCELED */
+        OutputPolicyType outputPolicy;          /*!< how compressed output reaches the disk (gzip file path only) */
+        qint64 writeBufferSize;                 /*!< size of the aligned staging buffer used by DIRECT_OUTPUT, rounded up to 4 KB */
+        bool dropCacheHint;                     /*!< when true, advise the kernel the source/destination pages are not needed again (posix_fadvise DONTNEED) */
+        bool pipelinedIo;                       /*!< when true, source reads, deflate and destination writes run as double-buffered stages on separate threads so I/O and compression overlap (gzip file path only) */
+        QByteArray presetDictionary;            /*!< primes deflate with shared boilerplate before the data, boosting ratio on batches of similar small files (gzip path only). \warning the output deviates from plain RFC 1952: it can reference the dictionary, so only NrGzipReader primed with the \em same dictionary (not gunzip) can decompress it */
+        NrCompressionStats *stats;              /*!< when set, receives the job's performance counters (reset at job start, not owned) */
+        bool arenaAllocator;                    /*!< when true, miniz's internal allocations for the job are bump-allocated from a per-job arena and freed in one shot, keeping batch workloads off the process heap (zip paths only); frees are no-ops, so on extraction the arena retains every per-entry read buffer until the job ends and grows with the entry count - meant for short single-file jobs */
+        QString dedupCacheDir;                  /*!< when set, compressed outputs are cached in this directory keyed on the source content (SHA-256 + level) and byte-identical sources are served by hardlinking/copying the cached artifact instead of recompressing (gzip file path only) */
+
+        CompressorOptions()
+            : progressGranularity(8 * 1024 * 1024), cancelToken(nullptr),
+              outputPolicy(BUFFERED_OUTPUT), writeBufferSize(1024 * 1024), dropCacheHint(false),
+              pipelinedIo(false), stats(nullptr), arenaAllocator(false)
+        { /* empty */ }
+    };
+
+    /*! one entry of a fileCompressBatch() submission */
+    struct CompressionTask {
+        QString filename;                       /*!< the filename (without path) of the file to be compressed */
+        QString srcpath;                        /*!< the path where the file to be compressed is located */
+        QString dstpath;                        /*!< the path where the compressed file should be created */
+        compressedFileFormatEnum algo;          /*!< the type of compression to be used, either GZIP or ZIP */
+        int level;                              /*!< the compression level (0=none(faster) .. 9=max (slower)) */
+
+        CompressionTask()
+            : algo(GZIP_ARCHIVE), level(6)
+        { /* empty */ }
+
+        CompressionTask(const QString &fname, const QString &src, const QString &dst,
+                        compressedFileFormatEnum a, int lev = 6)
+            : filename(fname), srcpath(src), dstpath(dst), algo(a), level(lev)
+        { /* empty */ }
     };
 
 private:
     static quint8 getByte(quint32 var, quint8 bytenum);
-    static int writeGzipHeader(QFile *pFile, quint32 i_mtime);
-    static int writeGzipFooter(QFile *pFile, quint32 i_crc32, quint32 i_size);
+    static int writeGzipHeader(QIODevice *pFile, quint32 i_mtime);
+    static int writeGzipFooter(QIODevice *pFile, quint32 i_crc32, quint32 i_size);
+    static int compressGzipFileHooked(const QString &filename, const QString &srcpath, const QString &dstpath, int level,
+                                      const ProgressCallback &progressCb, const std::atomic<bool> *cancelToken,
+                                      const CompressorOptions *ioOptions = nullptr,
+                                      NrCompressorContextPrivate *ctx = nullptr);
+    static int compressGzipStreamCtx(QIODevice *in, QIODevice *out, int level, quint32 mtime,
+                                     NrCompressorContextPrivate *ctx);
+
+    friend class NrCompressionJob;
+    friend class NrCompressorContext;
+    friend class NrGzipStreamWriter;
 
 public:
     NrFileCompressor();
@@ -52,11 +180,71 @@ public:
     static int fileCompress(const QString &filename, const QString &srcpath, const QString &dstpath, NrFileCompressor::compressedFileFormatEnum algo, int lev=6); //Default compression level
     static QString getCompressedFilename(const QString &filename, NrFileCompressor::compressedFileFormatEnum algo);
 
+    static void registerBackend(compressedFileFormatEnum algo, NrCompressionBackend *backend);
+    static NrCompressionBackend *backend(compressedFileFormatEnum algo);
+
+    static void setNumaAwareWorkers(bool enabled);
+    static bool numaAwareWorkers();
+
+    static QList<int> fileCompressBatch(const QList<CompressionTask> &tasks, int threadCount = 0);
+
+#ifndef NRFILECOMPRESSOR_NO_ZIP
+#ifndef NRFILECOMPRESSOR_NO_ZIP_WRITER
     static int compressZipFile(const QString &filename, const QString &srcpath, const QString &dstpath, int level);
+    static int compressZipFile(const QString &filename, const QString &srcpath, const QString &dstpath, int level, const CompressorOptions &options);
+    static int compressZipBuffer(const QString &entryName, const QByteArray &in, QByteArray &out, int level);
+    static int compressZipFiles(const QStringList &srcFiles, const QString &dstArchive, int level, int threadCount = 0);
+    static int compressZipDirectory(const QString &srcDir, const QString &dstArchive, int level, int threadCount = 0);
+    static int appendToZipFile(const QString &filename, const QString &srcpath, const QString &archivePath, int level);
+    static int appendToZipFile(const QStringList &srcFiles, const QString &archivePath, int level);
+    static int recompressZipFile(const QString &srcArchive, const QString &dstArchive, int level, int threadCount = 0);
+#endif //NRFILECOMPRESSOR_NO_ZIP_WRITER
     static int uncompressZipFile(const QString &filename, const QString &destDir);
+    static int uncompressZipFile(const QString &filename, const QString &destDir, const CompressorOptions &options);
+    static int uncompressZipFileParallel(const QString &filename, const QString &destDir, int threadCount = 0);
+    static int uncompressZipEntry(const QString &filename, const QString &entryName, const QString &destDir);
+    static int uncompressZipEntryToBuffer(const QString &filename, const QString &entryName, QByteArray &out);
+    static int uncompressZipFileFiltered(const QString &filename, const QString &destDir, const QString &pattern);
+#endif //NRFILECOMPRESSOR_NO_ZIP
 
     static int compressGzipFile(const QString &filename, const QString &srcpath, const QString &dstpath, int level);
+    static int compressGzipFile(const QString &filename, const QString &srcpath, const QString &dstpath, int level, const CompressorOptions &options);
+    static int compressGzipFileParallel(const QString &filename, const QString &srcpath, const QString &dstpath, int level, int threadCount = 0);
+    static int compressGzipStream(QIODevice *in, QIODevice *out, int level, quint32 mtime = 0);
+    static int compressGzipBuffer(const QByteArray &in, QByteArray &out, int level);
+
+    static QByteArray trainCompressionDictionary(const QStringList &sampleFiles, int maxSize = 32 * 1024);
+
+};
+
+
+/*!
+ * \brief The NrCompressorContext class owns the gzip working state (the two
+ *        1 MB buffers and the miniz deflate stream) so it can be reused
+ *        across many files instead of being rebuilt on every call.
+ *
+ * The static NrFileCompressor API pays one buffer allocation plus a
+ * deflateInit2/deflateEnd pair per file; for batches of small files that
+ * setup dominates the runtime. Create one context per worker thread, call
+ * its compress methods in a loop and the deflate state is simply reset
+ * (deflateReset) between files. A context is not thread-safe: never share
+ * one between threads.
+ */
+class NrCompressorContext
+{
+public:
+    NrCompressorContext();
+    ~NrCompressorContext();
+
+    int compressGzipFile(const QString &filename, const QString &srcpath, const QString &dstpath, int level);
+    int compressGzipStream(QIODevice *in, QIODevice *out, int level, quint32 mtime = 0);
+
+private:
+    /* a context owns live miniz state: copying it makes no sense */
+    NrCompressorContext(const NrCompressorContext &other);
+    NrCompressorContext& operator=(const NrCompressorContext &other);
 
+    NrCompressorContextPrivate *d;
 };
 
 END_NRFILECOMPRESSOR_NAMESPACE
@@ -0,0 +1,418 @@
+/********************************************************************************
+ *   Copyright (C) 2018 by NetResults S.r.l. ( http://www.netresults.it )       *
+ *   Author(s):                                                                 *
+ *              Francesco Lamonica  <f.lamonica@netresults.it>                  *
+ ********************************************************************************/
+
+#include "NrGzipReader.h"
+#include "miniz.h"
+
+#include <QFile>
+#include <QIODevice>
+
+#include <iostream>
+
+
+BEGIN_NRFILECOMPRESSOR_NAMESPACE
+
+
+//size of the compressed-input buffer; together with the 32 KB inflate
+//window this bounds the reader's whole working set
+static const qint64 GZREAD_IN_BUF_SIZE = (256 * 1024);
+
+//gzip member header flags (RFC 1952)
+static const quint8 GZIP_FTEXT    = 0x01;
+static const quint8 GZIP_FHCRC    = 0x02;
+static const quint8 GZIP_FEXTRA   = 0x04;
+static const quint8 GZIP_FNAME    = 0x08;
+static const quint8 GZIP_FCOMMENT = 0x10;
+
+
+/* all the live inflate state, kept out of the public header */
+struct NrGzipReaderPrivate
+{
+    QIODevice *source;          /* where compressed bytes come from (not owned unless ownedFile) */
+    QFile *ownedFile;           /* set when the reader was built from a path */
+    bool opened;
+    bool endOfStream;           /* every member consumed and verified */
+    int errorCode;              /* 0 or one of NrFileCompressor::CompressErrorType */
+
+    tinfl_decompressor inflator;
+    QByteArray inBuf;           /* compressed input, refilled in GZREAD_IN_BUF_SIZE reads */
+    qint64 inOfs;
+    qint64 inAvail;
+
+    quint8 dict[TINFL_LZ_DICT_SIZE];    /* tinfl's 32 KB sliding output window */
+    size_t dictOfs;             /* next write position inside dict */
+    size_t pendingPos;          /* first decompressed-but-unread byte inside dict */
+    size_t pendingLen;          /* how many decompressed bytes wait to be read() */
+
+    bool memberDone;            /* deflate stream of the current member ended, trailer pending */
+    quint32 crc;                /* running CRC-32 of the current member's output */
+    quint32 isize;              /* running size (mod 2^32) of the current member's output */
+    QByteArray presetDict;      /* seeds the window before each member (non-standard streams, see setPresetDictionary()) */
+
+    NrGzipReaderPrivate()
+        : source(nullptr), ownedFile(nullptr), opened(false), endOfStream(false), errorCode(0),
+          inOfs(0), inAvail(0), dictOfs(0), pendingPos(0), pendingLen(0),
+          memberDone(false), crc(MZ_CRC32_INIT), isize(0)
+    {
+        inBuf.resize(GZREAD_IN_BUF_SIZE);
+        tinfl_init(&inflator);
+    }
+
+    /* pulls the next compressed byte, refilling the buffer as needed; false at end of source */
+    bool nextByte(quint8 &o_byte)
+    {
+        if (inAvail == 0) {
+            qint64 got = source->read(inBuf.data(), inBuf.size());
+            if (got <= 0) {
+                return false;
+            }
+            inOfs = 0;
+            inAvail = got;
+        }
+        o_byte = (quint8)inBuf.at((int)inOfs);
+        ++inOfs;
+        --inAvail;
+        return true;
+    }
+
+    /* skips i_count compressed bytes; false if the source ends first */
+    bool skipBytes(qint64 i_count)
+    {
+        quint8 b;
+        while (i_count-- > 0) {
+            if (!nextByte(b)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* reads a little-endian 32 bit value; false if the source ends first */
+    bool readLe32(quint32 &o_value)
+    {
+        quint8 b0, b1, b2, b3;
+        if (!nextByte(b0) || !nextByte(b1) || !nextByte(b2) || !nextByte(b3)) {
+            return false;
+        }
+        o_value = (quint32)b0 | ((quint32)b1 << 8) | ((quint32)b2 << 16) | ((quint32)b3 << 24);
+        return true;
+    }
+
+    /* preloads the sliding window with the preset dictionary so back-references
+       into it resolve; the window write position moves past the seeded bytes */
+    void seedWindow()
+    {
+        if (presetDict.isEmpty()) {
+            return;
+        }
+        size_t n = (size_t)presetDict.size();
+        const char *p = presetDict.constData();
+        if (n > TINFL_LZ_DICT_SIZE) {
+            p += n - TINFL_LZ_DICT_SIZE;
+            n = TINFL_LZ_DICT_SIZE;
+        }
+        memcpy(dict, p, n);
+        dictOfs = n & (TINFL_LZ_DICT_SIZE - 1);
+    }
+};
+
+
+NrGzipReader::NrGzipReader(QIODevice *source)
+    : d(new NrGzipReaderPrivate)
+{
+    d->source = source;
+}
+
+
+NrGzipReader::NrGzipReader(const QString &filePath)
+    : d(new NrGzipReaderPrivate)
+{
+    d->ownedFile = new QFile(filePath);
+    d->source = d->ownedFile;
+}
+
+
+NrGzipReader::~NrGzipReader()
+{
+    close();
+    delete d->ownedFile;
+    delete d;
+}
+
+
+/* parses one gzip member header starting at the current input position;
+   returns 0 on success, 1 when the source is cleanly exhausted (no more
+   members) and a negative error code on a corrupt header */
+static int parseMemberHeader(NrGzipReaderPrivate *d)
+{
+    quint8 id1;
+    if (!d->nextByte(id1)) {
+        return 1; //clean end of the source: no further member
+    }
+
+    quint8 id2, method, flags;
+    if (!d->nextByte(id2) || !d->nextByte(method) || !d->nextByte(flags)) {
+        std::cerr << "Truncated gzip header" << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+    if (id1 != 0x1F || id2 != 0x8B || method != 8) {
+        std::cerr << "Not a gzip stream (bad magic or compression method)" << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    //MTIME(4) XFL(1) OS(1)
+    if (!d->skipBytes(6)) {
+        std::cerr << "Truncated gzip header" << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    if (flags & GZIP_FEXTRA) {
+        quint8 lo, hi;
+        if (!d->nextByte(lo) || !d->nextByte(hi) || !d->skipBytes((qint64)lo | ((qint64)hi << 8))) {
+            std::cerr << "Truncated gzip FEXTRA field" << std::endl;
+            return NrFileCompressor::E_MINIZ_ERROR;
+        }
+    }
+    if (flags & GZIP_FNAME) {
+        quint8 b;
+        do {
+            if (!d->nextByte(b)) {
+                std::cerr << "Truncated gzip FNAME field" << std::endl;
+                return NrFileCompressor::E_MINIZ_ERROR;
+            }
+        } while (b != 0);
+    }
+    if (flags & GZIP_FCOMMENT) {
+        quint8 b;
+        do {
+            if (!d->nextByte(b)) {
+                std::cerr << "Truncated gzip FCOMMENT field" << std::endl;
+                return NrFileCompressor::E_MINIZ_ERROR;
+            }
+        } while (b != 0);
+    }
+    if (flags & GZIP_FHCRC) {
+        if (!d->skipBytes(2)) {
+            std::cerr << "Truncated gzip FHCRC field" << std::endl;
+            return NrFileCompressor::E_MINIZ_ERROR;
+        }
+    }
+
+    (void)GZIP_FTEXT; //informational flag only, nothing to consume
+
+    return 0;
+}
+
+
+/*!
+ * \brief NrGzipReader::open opens the source (when path-based) and parses the first gzip member header
+ * \return true if the reader is ready to stream decompressed data; on failure error() holds the code
+ */
+bool NrGzipReader::open()
+{
+    if (d->opened) {
+        return true;
+    }
+
+    if (d->ownedFile && !d->ownedFile->open(QIODevice::ReadOnly)) {
+        std::cerr << "Cannot open gzip file " << d->ownedFile->fileName().toStdString() << std::endl;
+        d->errorCode = NrFileCompressor::E_FILE_NOT_OPEN;
+        return false;
+    }
+    if (!d->source || !d->source->isOpen() || !d->source->isReadable()) {
+        std::cerr << "Gzip source device is not open for reading" << std::endl;
+        d->errorCode = NrFileCompressor::E_FILE_NOT_OPEN;
+        return false;
+    }
+
+    int res = parseMemberHeader(d);
+    if (res != 0) {
+        //an immediately-empty source is not a valid gzip stream either
+        d->errorCode = NrFileCompressor::E_MINIZ_ERROR;
+        return false;
+    }
+
+    d->seedWindow();
+
+    d->opened = true;
+    return true;
+}
+
+
+/*!
+ * \brief NrGzipReader::setPresetDictionary primes the inflate window with a preset dictionary
+ * \param dictionary the same dictionary the stream was compressed with (see CompressorOptions::presetDictionary)
+ *
+ * Call before open(). Streams produced with a preset dictionary are not
+ * plain RFC 1952 gzip: they can back-reference the dictionary, so reading
+ * them requires priming with the identical bytes. The window is re-seeded
+ * for every member of a concatenated stream.
+ */
+void NrGzipReader::setPresetDictionary(const QByteArray &dictionary)
+{
+    d->presetDict = dictionary;
+}
+
+
+/*!
+ * \brief NrGzipReader::close releases the source (closing the file when the reader owns it)
+ */
+void NrGzipReader::close()
+{
+    if (d->ownedFile && d->ownedFile->isOpen()) {
+        d->ownedFile->close();
+    }
+    d->opened = false;
+}
+
+
+/* verifies the 8 byte member trailer and starts the next member, if any;
+   returns 0 to keep pumping, 1 on clean end of stream, negative on error */
+static int finishMember(NrGzipReaderPrivate *d)
+{
+    quint32 storedCrc, storedSize;
+    if (!d->readLe32(storedCrc) || !d->readLe32(storedSize)) {
+        std::cerr << "Truncated gzip trailer" << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+    if (storedCrc != d->crc || storedSize != d->isize) {
+        std::cerr << "Gzip CRC/size mismatch: stream is corrupt" << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    int res = parseMemberHeader(d);
+    if (res < 0) {
+        return res;
+    }
+    if (res == 1) {
+        return 1; //no further member
+    }
+
+    //another member follows (concatenated gzip): reset the per-member state
+    tinfl_init(&d->inflator);
+    d->seedWindow();
+    d->memberDone = false;
+    d->crc = MZ_CRC32_INIT;
+    d->isize = 0;
+    return 0;
+}
+
+
+/* inflates more data into the window; fills d->pendingPos/pendingLen.
+   Returns 0 to keep going, 1 on clean end of stream, negative on error. */
+static int pump(NrGzipReaderPrivate *d)
+{
+    if (d->memberDone) {
+        int res = finishMember(d);
+        if (res != 0) {
+            return res;
+        }
+    }
+
+    if (d->inAvail == 0) {
+        qint64 got = d->source->read(d->inBuf.data(), d->inBuf.size());
+        if (got < 0) {
+            std::cerr << "Error reading gzip source device" << std::endl;
+            return NrFileCompressor::E_FILE_NOT_OPEN;
+        }
+        d->inOfs = 0;
+        d->inAvail = got;
+    }
+
+    size_t inBytes = (size_t)d->inAvail;
+    size_t outBytes = TINFL_LZ_DICT_SIZE - d->dictOfs;
+    const bool moreInput = (d->inAvail > 0) || !d->source->atEnd();
+
+    tinfl_status status = tinfl_decompress(&d->inflator,
+                                           (const mz_uint8 *)d->inBuf.constData() + d->inOfs, &inBytes,
+                                           d->dict, d->dict + d->dictOfs, &outBytes,
+                                           moreInput ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+
+    d->inOfs += (qint64)inBytes;
+    d->inAvail -= (qint64)inBytes;
+
+    if (outBytes > 0) {
+        d->crc = (quint32)mz_crc32(d->crc, d->dict + d->dictOfs, outBytes);
+        d->isize += (quint32)outBytes;
+        d->pendingPos = d->dictOfs;
+        d->pendingLen = outBytes;
+        d->dictOfs = (d->dictOfs + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+    }
+
+    if (status == TINFL_STATUS_DONE) {
+        d->memberDone = true;
+        return 0;
+    }
+    if (status == TINFL_STATUS_NEEDS_MORE_INPUT) {
+        if (!moreInput) {
+            std::cerr << "Truncated gzip stream" << std::endl;
+            return NrFileCompressor::E_MINIZ_ERROR;
+        }
+        return 0;
+    }
+    if (status < 0) {
+        std::cerr << "Error while inflating gzip stream (tinfl status " << status << ")" << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    return 0; //TINFL_STATUS_HAS_MORE_OUTPUT: window full, come back after the caller drained it
+}
+
+
+/*!
+ * \brief NrGzipReader::read yields the next chunk of decompressed data
+ * \param data the destination buffer
+ * \param maxlen the capacity of \a data
+ * \return the number of bytes stored (possibly less than \a maxlen), 0 at end of stream, -1 on error (see error())
+ */
+qint64 NrGzipReader::read(char *data, qint64 maxlen)
+{
+    if (!d->opened || d->errorCode != 0 || maxlen < 0) {
+        return -1;
+    }
+
+    while (d->pendingLen == 0 && !d->endOfStream) {
+        int res = pump(d);
+        if (res < 0) {
+            d->errorCode = res;
+            return -1;
+        }
+        if (res == 1) {
+            d->endOfStream = true;
+        }
+    }
+
+    qint64 n = qMin<qint64>(maxlen, (qint64)d->pendingLen);
+    if (n > 0) {
+        memcpy(data, d->dict + d->pendingPos, (size_t)n);
+        d->pendingPos += (size_t)n;
+        d->pendingLen -= (size_t)n;
+    }
+    return n;
+}
+
+
+/*!
+ * \brief NrGzipReader::atEnd
+ * \return true once every decompressed byte has been read() and the trailing checksums verified
+ */
+bool NrGzipReader::atEnd() const
+{
+    return d->endOfStream && d->pendingLen == 0;
+}
+
+
+/*!
+ * \brief NrGzipReader::error
+ * \return 0, or the NrFileCompressor::CompressErrorType code of the first failure
+ */
+int NrGzipReader::error() const
+{
+    return d->errorCode;
+}
+
+
+END_NRFILECOMPRESSOR_NAMESPACE
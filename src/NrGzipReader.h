@@ -0,0 +1,71 @@
+/********************************************************************************
+ *   Copyright (C) 2018 by NetResults S.r.l. ( http://www.netresults.it )       *
+ *   Author(s):                                                                 *
+ *              Francesco Lamonica  <f.lamonica@netresults.it>                  *
+ ********************************************************************************/
+
+#ifndef NRGZIPREADER_H
+#define NRGZIPREADER_H
+
+#include "NrFileCompressor.h"
+
+#include <QString>
+
+class QIODevice;
+
+
+BEGIN_NRFILECOMPRESSOR_NAMESPACE
+
+struct NrGzipReaderPrivate;
+
+/*!
+ * \brief The NrGzipReader class decompresses a gzip stream incrementally,
+ *        yielding chunks on demand with a fixed working set.
+ *
+ * It pulls compressed bytes from the source in small reads and inflates
+ * them through miniz's tinfl machinery into a 32 KB sliding window, so
+ * memory usage stays constant no matter how large the stream is - a
+ * 50 GB log can be scanned with the same footprint as a 4 KB one.
+ * Concatenated gzip members (the output of `cat a.gz b.gz`) are read
+ * back to back as one logical stream, and the CRC-32 and size trailer
+ * of every member is verified.
+ *
+ * Typical use:
+ * \code
+ *   NrGzipReader reader("big.log.gz");
+ *   if (!reader.open()) { ... }
+ *   char buf[64 * 1024];
+ *   qint64 n;
+ *   while ((n = reader.read(buf, sizeof(buf))) > 0) {
+ *       // consume n decompressed bytes
+ *   }
+ *   if (n < 0) { ... } // reader.error() holds the code
+ * \endcode
+ */
+class NrGzipReader
+{
+public:
+    explicit NrGzipReader(QIODevice *source);
+    explicit NrGzipReader(const QString &filePath);
+    ~NrGzipReader();
+
+    bool open();
+    void close();
+
+    void setPresetDictionary(const QByteArray &dictionary);
+
+    qint64 read(char *data, qint64 maxlen);
+    bool atEnd() const;
+    int error() const;
+
+private:
+    /* the reader owns live inflate state: copying it makes no sense */
+    NrGzipReader(const NrGzipReader &other);
+    NrGzipReader& operator=(const NrGzipReader &other);
+
+    NrGzipReaderPrivate *d;
+};
+
+END_NRFILECOMPRESSOR_NAMESPACE
+
+#endif // NRGZIPREADER_H
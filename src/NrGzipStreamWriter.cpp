@@ -0,0 +1,301 @@
+/********************************************************************************
+ *   Copyright (C) 2018 by NetResults S.r.l. ( http://www.netresults.it )       *
+ *   Author(s):                                                                 *
+ *              Francesco Lamonica  <f.lamonica@netresults.it>                  *
+ ********************************************************************************/
+
+#include "NrGzipStreamWriter.h"
+#include "miniz.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QIODevice>
+
+#include <iostream>
+#include <memory>
+
+
+BEGIN_NRFILECOMPRESSOR_NAMESPACE
+
+
+//size of the compressed-output staging buffer; drained to the sink inside
+//the deflate loop, so it only bounds the write granularity, not the stream
+static const qint64 GZWRITE_OUT_BUF_SIZE = (256 * 1024);
+
+
+/* all the live deflate state, kept out of the public header */
+struct NrGzipStreamWriterPrivate
+{
+    QIODevice *sink;            /* where compressed bytes go (not owned unless ownedFile) */
+    QFile *ownedFile;           /* set when the writer was built from a path */
+    bool opened;
+    bool finished;              /* finish() ran: the stream is terminated */
+    int errorCode;              /* 0 or one of NrFileCompressor::CompressErrorType */
+    int level;
+
+    z_stream stream;
+    bool streamInit;
+    std::unique_ptr<unsigned char[]> outBuf;
+
+    quint32 crc;                /* running CRC-32 of the uncompressed payload */
+    quint32 isize;              /* running payload size (mod 2^32) for the footer */
+
+    qint64 byteWatermark;       /* auto-flush after this many unflushed bytes (0 = off) */
+    int msecWatermark;          /* auto-flush when this much time passed since the last flush (0 = off) */
+    qint64 bytesSinceFlush;
+    QElapsedTimer sinceFlush;
+
+    NrGzipStreamWriterPrivate()
+        : sink(nullptr), ownedFile(nullptr), opened(false), finished(false), errorCode(0),
+          level(MZ_DEFAULT_LEVEL), streamInit(false),
+          crc(MZ_CRC32_INIT), isize(0),
+          byteWatermark(0), msecWatermark(0), bytesSinceFlush(0)
+    {
+        memset(&stream, 0, sizeof(stream));
+        outBuf.reset(new unsigned char[GZWRITE_OUT_BUF_SIZE]);
+    }
+
+    /* runs deflate with the given flush mode until everything it can emit
+       reached the sink; the input is fed in bounded chunks (avail_in is only
+       32 bits wide, so a single huge write must not be handed over whole);
+       false (and errorCode set) on a deflate or sink error */
+    bool pump(const char *i_data, qint64 i_len, int i_flushMode)
+    {
+        qint64 fed = 0;
+        do {
+            const qint64 chunk = qMin(i_len - fed, GZWRITE_OUT_BUF_SIZE);
+            stream.next_in = reinterpret_cast<const unsigned char *>(i_data) + fed;
+            stream.avail_in = static_cast<unsigned int>(chunk);
+            fed += chunk;
+            //intermediate chunks are plain feeds; only the final one carries
+            //the caller's flush mode
+            const int flushMode = (fed < i_len) ? Z_NO_FLUSH : i_flushMode;
+
+            for ( ; ; ) {
+                stream.next_out = outBuf.get();
+                stream.avail_out = static_cast<unsigned int>(GZWRITE_OUT_BUF_SIZE);
+
+                int status = deflate(&stream, flushMode);
+
+                qint64 n = GZWRITE_OUT_BUF_SIZE - stream.avail_out;
+                if (n > 0 && sink->write(reinterpret_cast<const char *>(outBuf.get()), n) != n) {
+                    std::cerr << "Failed writing to gzip stream sink!" << std::endl;
+                    errorCode = NrFileCompressor::E_FILE_NOT_WRITEABLE;
+                    return false;
+                }
+
+                if (status == Z_STREAM_END) {
+                    return true;
+                }
+                //Z_BUF_ERROR just means deflate had nothing left to do (e.g. a
+                //sync flush with an already-empty pending buffer): not an error
+                if (status != Z_OK && status != Z_BUF_ERROR) {
+                    std::cerr << "deflate() failed with status: " << status << std::endl;
+                    errorCode = NrFileCompressor::E_MINIZ_ERROR;
+                    return false;
+                }
+                //this chunk is done once all its input is consumed and the
+                //output buffer was not filled to the brim (i.e. nothing is
+                //left pending inside deflate)
+                if (stream.avail_in == 0 && stream.avail_out != 0) {
+                    break;
+                }
+            }
+        } while (fed < i_len);
+
+        return true;
+    }
+};
+
+
+NrGzipStreamWriter::NrGzipStreamWriter(QIODevice *sink, int level)
+    : d(new NrGzipStreamWriterPrivate)
+{
+    d->sink = sink;
+    d->level = level;
+}
+
+
+NrGzipStreamWriter::NrGzipStreamWriter(const QString &filePath, int level)
+    : d(new NrGzipStreamWriterPrivate)
+{
+    d->ownedFile = new QFile(filePath);
+    d->sink = d->ownedFile;
+    d->level = level;
+}
+
+
+NrGzipStreamWriter::~NrGzipStreamWriter()
+{
+    //an abandoned stream is still terminated properly (best effort)
+    if (d->opened && !d->finished) {
+        finish();
+    }
+    if (d->streamInit) {
+        deflateEnd(&d->stream);
+    }
+    delete d->ownedFile;
+    delete d;
+}
+
+
+/*!
+ * \brief NrGzipStreamWriter::open opens the sink (when path-based), writes the gzip header and sets up the deflate stream
+ * \param mtime the modification time (seconds since the epoch) to store in the gzip header, 0 if not meaningful
+ * \return true if the writer is ready to accept data; on failure error() holds the code
+ */
+bool NrGzipStreamWriter::open(quint32 mtime)
+{
+    if (d->opened) {
+        return true;
+    }
+
+    if (d->ownedFile && !d->ownedFile->open(QIODevice::WriteOnly)) {
+        std::cerr << "Cannot open gzip file " << d->ownedFile->fileName().toStdString() << std::endl;
+        d->errorCode = NrFileCompressor::E_FILE_NOT_OPEN;
+        return false;
+    }
+
+    if (deflateInit2(&d->stream, d->level, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 9, MZ_DEFAULT_STRATEGY) != Z_OK) {
+        std::cerr << "deflateInit2() failed!" << std::endl;
+        d->errorCode = NrFileCompressor::E_MINIZ_ERROR;
+        return false;
+    }
+    d->streamInit = true;
+
+    if (NrFileCompressor::writeGzipHeader(d->sink, mtime) != 0) {
+        d->errorCode = NrFileCompressor::E_FILE_NOT_WRITEABLE;
+        return false;
+    }
+
+    d->sinceFlush.start();
+    d->opened = true;
+    return true;
+}
+
+
+/*!
+ * \brief NrGzipStreamWriter::setAutoFlush bounds the latency of buffered data without manual flush() calls
+ * \param byteWatermark flush once this many bytes were written since the last flush, 0 disables the byte trigger
+ * \param msecWatermark flush when at least this much time passed since the last flush, 0 disables the time trigger
+ *
+ * The time trigger is passive: it is evaluated on the next write(), so a
+ * completely idle stream stays unflushed until data arrives (drive a timer
+ * calling flush() externally if idle streams must drain too).
+ */
+void NrGzipStreamWriter::setAutoFlush(qint64 byteWatermark, int msecWatermark)
+{
+    d->byteWatermark = byteWatermark;
+    d->msecWatermark = msecWatermark;
+}
+
+
+/*!
+ * \brief NrGzipStreamWriter::write compresses a chunk of payload into the stream
+ * \param data the payload bytes
+ * \param len how many bytes to write
+ * \return len if successful, -1 otherwise (error() holds the code)
+ */
+qint64 NrGzipStreamWriter::write(const char *data, qint64 len)
+{
+    if (!d->opened || d->finished || d->errorCode != 0) {
+        return -1;
+    }
+    if (len <= 0) {
+        return 0;
+    }
+
+    d->crc = static_cast<quint32>(mz_crc32(d->crc, reinterpret_cast<const unsigned char *>(data), static_cast<size_t>(len)));
+    d->isize += static_cast<quint32>(len);
+
+    if (!d->pump(data, len, Z_NO_FLUSH)) {
+        return -1;
+    }
+
+    d->bytesSinceFlush += len;
+    bool byteTrip = (d->byteWatermark > 0 && d->bytesSinceFlush >= d->byteWatermark);
+    bool timeTrip = (d->msecWatermark > 0 && d->sinceFlush.elapsed() >= d->msecWatermark);
+    if ((byteTrip || timeTrip) && !flush()) {
+        return -1;
+    }
+
+    return len;
+}
+
+
+/*!
+ * \brief NrGzipStreamWriter::write convenience overload taking a QByteArray
+ * \param data the payload bytes
+ * \return data.size() if successful, -1 otherwise
+ */
+qint64 NrGzipStreamWriter::write(const QByteArray &data)
+{
+    return write(data.constData(), data.size());
+}
+
+
+/*!
+ * \brief NrGzipStreamWriter::flush emits everything written so far as decodable output (sync flush)
+ * \return true if successful
+ *
+ * Performs a Z_SYNC_FLUSH: deflate closes the current block and emits an
+ * empty stored block, leaving the output byte-aligned, so the receiving
+ * side can decompress every byte written up to this point. The stream
+ * itself stays open for further writes.
+ */
+bool NrGzipStreamWriter::flush()
+{
+    if (!d->opened || d->finished || d->errorCode != 0) {
+        return false;
+    }
+
+    if (!d->pump(nullptr, 0, Z_SYNC_FLUSH)) {
+        return false;
+    }
+
+    d->bytesSinceFlush = 0;
+    d->sinceFlush.restart();
+    return true;
+}
+
+
+/*!
+ * \brief NrGzipStreamWriter::finish terminates the gzip stream (final block plus CRC-32/size footer)
+ * \return true if successful
+ *
+ * After this call the sink holds one complete gzip member; further writes
+ * are rejected. The sink itself is not closed (it may be a long-lived
+ * socket carrying other traffic afterwards).
+ */
+bool NrGzipStreamWriter::finish()
+{
+    if (!d->opened || d->finished) {
+        return false;
+    }
+
+    if (d->errorCode == 0 && d->pump(nullptr, 0, Z_FINISH)) {
+        if (NrFileCompressor::writeGzipFooter(d->sink, d->crc, d->isize) != 0) {
+            d->errorCode = NrFileCompressor::E_FILE_NOT_WRITEABLE;
+        }
+    }
+
+    if (d->ownedFile) {
+        d->ownedFile->close();
+    }
+
+    d->finished = true;
+    return d->errorCode == 0;
+}
+
+
+/*!
+ * \brief NrGzipStreamWriter::error
+ * \return 0, or the NrFileCompressor::CompressErrorType code of the first failure
+ */
+int NrGzipStreamWriter::error() const
+{
+    return d->errorCode;
+}
+
+
+END_NRFILECOMPRESSOR_NAMESPACE
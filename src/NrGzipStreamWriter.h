@@ -0,0 +1,81 @@
+/********************************************************************************
+ *   Copyright (C) 2018 by NetResults S.r.l. ( http://www.netresults.it )       *
+ *   Author(s):                                                                 *
+ *              Francesco Lamonica  <f.lamonica@netresults.it>                  *
+ ********************************************************************************/
+
+#ifndef NRGZIPSTREAMWRITER_H
+#define NRGZIPSTREAMWRITER_H
+
+#include "NrFileCompressor.h"
+
+#include <QString>
+
+class QIODevice;
+
+
+BEGIN_NRFILECOMPRESSOR_NAMESPACE
+
+struct NrGzipStreamWriterPrivate;
+
+/*!
+ * \brief The NrGzipStreamWriter class keeps one gzip stream open across many
+ *        writes, with explicit flush control for bounded-latency shipping.
+ *
+ * The one-shot compressGzip*() calls only flush at end of stream, which is
+ * right for files but useless for agents pushing compressed records over
+ * the wire: every batch would pay a full header/deflate-state/footer cycle.
+ * This writer amortizes one deflate stream over the connection lifetime:
+ * write() appends records, flush() performs a sync flush that emits a
+ * byte-aligned block so the receiver can decode everything written so far,
+ * and finish() terminates the stream with the CRC-32/size footer. The
+ * result is one standard gzip member, readable by gunzip or NrGzipReader.
+ *
+ * An auto-flush watermark (setAutoFlush()) bounds latency without manual
+ * flush calls: the stream is flushed whenever the given number of bytes
+ * has been written since the last flush, or - checked on the next write()
+ * - when the given time has passed.
+ *
+ * Typical use:
+ * \code
+ *   NrGzipStreamWriter writer(socket);
+ *   writer.setAutoFlush(64 * 1024, 200);
+ *   if (!writer.open()) { ... }
+ *   while (haveRecords()) {
+ *       writer.write(nextRecord());
+ *   }
+ *   writer.finish();
+ * \endcode
+ *
+ * \note a sync flush costs ~5 bytes of framing plus a ratio hit from the
+ *       shortened deflate blocks: flush as often as latency demands, not more
+ */
+class NrGzipStreamWriter
+{
+public:
+    explicit NrGzipStreamWriter(QIODevice *sink, int level = 6);
+    explicit NrGzipStreamWriter(const QString &filePath, int level = 6);
+    ~NrGzipStreamWriter();
+
+    bool open(quint32 mtime = 0);
+
+    void setAutoFlush(qint64 byteWatermark, int msecWatermark = 0);
+
+    qint64 write(const char *data, qint64 len);
+    qint64 write(const QByteArray &data);
+    bool flush();
+    bool finish();
+
+    int error() const;
+
+private:
+    /* the writer owns live deflate state: copying it makes no sense */
+    NrGzipStreamWriter(const NrGzipStreamWriter &other);
+    NrGzipStreamWriter& operator=(const NrGzipStreamWriter &other);
+
+    NrGzipStreamWriterPrivate *d;
+};
+
+END_NRFILECOMPRESSOR_NAMESPACE
+
+#endif // NRGZIPSTREAMWRITER_H
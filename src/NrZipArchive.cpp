@@ -0,0 +1,338 @@
+/********************************************************************************
+ *   Copyright (C) 2018 by NetResults S.r.l. ( http://www.netresults.it )       *
+ *   Author(s):                                                                 *
+ *              Francesco Lamonica  <f.lamonica@netresults.it>                  *
+ ********************************************************************************/
+
+#include "NrZipArchive.h"
+#include "miniz.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+
+#include <iostream>
+
+
+BEGIN_NRFILECOMPRESSOR_NAMESPACE
+
+
+//sidecar index file layout versioning
+static const quint32 SIDECAR_MAGIC = 0x4E525A49; //'NRZI'
+static const quint16 SIDECAR_VERSION = 1;
+
+
+/* what the index remembers about one entry */
+struct NrZipIndexEntry
+{
+    quint32 index;          /* position in the central directory */
+    quint64 uncompSize;
+};
+
+
+struct NrZipArchivePrivate
+{
+    QString archivePath;
+    bool opened;
+
+    mz_zip_archive zip;
+    bool readerReady;       /* miniz reader initialized (false after a sidecar-only open) */
+
+    QHash<QString, NrZipIndexEntry> index;
+    QStringList names;      /* entry names in central-directory order */
+
+    NrZipArchivePrivate()
+        : opened(false), readerReady(false)
+    {
+        memset(&zip, 0, sizeof(zip));
+    }
+
+    /* initializes the miniz reader on demand (first extraction after a sidecar open) */
+    bool ensureReader()
+    {
+        if (readerReady) {
+            return true;
+        }
+        if (!mz_zip_reader_init_file(&zip, archivePath.toLatin1().constData(), 0)) {
+            std::cerr << "" << mz_zip_get_error_string(mz_zip_get_last_error(&zip)) << std::endl;
+            return false;
+        }
+        readerReady = true;
+        return true;
+    }
+
+    /* full central-directory parse, filling the hash index */
+    bool parseCentralDirectory()
+    {
+        if (!ensureReader()) {
+            return false;
+        }
+
+        uint count = mz_zip_reader_get_num_files(&zip);
+        index.reserve((int)count);
+
+        for (uint i = 0; i < count; ++i) {
+            mz_zip_archive_file_stat file_stat;
+            if (!mz_zip_reader_file_stat(&zip, i, &file_stat)) {
+                continue;
+            }
+            if (mz_zip_reader_is_file_a_directory(&zip, i)) {
+                continue;
+            }
+
+            NrZipIndexEntry e;
+            e.index = i;
+            e.uncompSize = file_stat.m_uncomp_size;
+            QString name = QString(file_stat.m_filename);
+            index.insert(name, e);
+            names.append(name);
+        }
+        return true;
+    }
+};
+
+
+NrZipArchive::NrZipArchive(const QString &archivePath)
+    : d(new NrZipArchivePrivate)
+{
+    d->archivePath = archivePath;
+}
+
+
+NrZipArchive::~NrZipArchive()
+{
+    close();
+    delete d;
+}
+
+
+/*!
+ * \brief NrZipArchive::open parses the central directory and builds the name index
+ * \return true if the archive was opened and indexed
+ */
+bool NrZipArchive::open()
+{
+    if (d->opened) {
+        return true;
+    }
+    if (!d->parseCentralDirectory()) {
+        return false;
+    }
+    d->opened = true;
+    return true;
+}
+
+
+/*!
+ * \brief NrZipArchive::open same as above, but loads a serialized sidecar index when it is still valid
+ * \param sidecarIndexPath the path of an index previously written by saveIndex()
+ * \return true if the archive was opened (from the sidecar or, failing that, from a full parse)
+ *
+ * The sidecar is trusted only when the archive's current size and mtime
+ * match the ones recorded at save time; a stale or unreadable sidecar
+ * silently falls back to the regular central-directory parse.
+ */
+bool NrZipArchive::open(const QString &sidecarIndexPath)
+{
+    if (d->opened) {
+        return true;
+    }
+
+    QFile sidecar(sidecarIndexPath);
+    if (sidecar.open(QIODevice::ReadOnly)) {
+        QDataStream in(&sidecar);
+        in.setVersion(QDataStream::Qt_5_0);
+
+        quint32 magic = 0;
+        quint16 version = 0;
+        qint64 archSize = 0, archMtime = 0;
+        quint32 count = 0;
+        in >> magic >> version >> archSize >> archMtime >> count;
+
+        QFileInfo archInfo(d->archivePath);
+        if (magic == SIDECAR_MAGIC && version == SIDECAR_VERSION
+            && archSize == archInfo.size()
+            && archMtime == archInfo.lastModified().toMSecsSinceEpoch() / 1000
+            && in.status() == QDataStream::Ok) {
+
+            QHash<QString, NrZipIndexEntry> idx;
+            QStringList names;
+            idx.reserve((int)count);
+            for (quint32 i = 0; i < count; ++i) {
+                QString name;
+                NrZipIndexEntry e;
+                in >> name >> e.index >> e.uncompSize;
+                idx.insert(name, e);
+                names.append(name);
+            }
+
+            if (in.status() == QDataStream::Ok) {
+                //index served from the sidecar: the miniz reader stays
+                //uninitialized until the first extraction needs it
+                d->index = idx;
+                d->names = names;
+                d->opened = true;
+                return true;
+            }
+        }
+    }
+
+    return open();
+}
+
+
+/*!
+ * \brief NrZipArchive::close drops the index and the miniz reader state
+ */
+void NrZipArchive::close()
+{
+    if (d->readerReady) {
+        mz_zip_reader_end(&d->zip);
+        d->readerReady = false;
+    }
+    d->index.clear();
+    d->names.clear();
+    d->opened = false;
+}
+
+
+/*!
+ * \brief NrZipArchive::saveIndex serializes the parsed index next to the archive
+ * \param sidecarIndexPath where to write the index file
+ * \return true if the index was written
+ */
+bool NrZipArchive::saveIndex(const QString &sidecarIndexPath) const
+{
+    if (!d->opened) {
+        return false;
+    }
+
+    QFile sidecar(sidecarIndexPath);
+    if (!sidecar.open(QIODevice::WriteOnly)) {
+        std::cerr << "Cannot write sidecar index " << sidecarIndexPath.toStdString() << std::endl;
+        return false;
+    }
+
+    QFileInfo archInfo(d->archivePath);
+    QDataStream out(&sidecar);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << SIDECAR_MAGIC << SIDECAR_VERSION
+        << (qint64)archInfo.size()
+        << (qint64)(archInfo.lastModified().toMSecsSinceEpoch() / 1000)
+        << (quint32)d->names.size();
+
+    for (int i = 0; i < d->names.size(); ++i) {
+        const NrZipIndexEntry &e = d->index.value(d->names.at(i));
+        out << d->names.at(i) << e.index << e.uncompSize;
+    }
+
+    return out.status() == QDataStream::Ok;
+}
+
+
+/*!
+ * \brief NrZipArchive::entryCount
+ * \return the number of (non-directory) entries in the archive, or 0 when not open
+ */
+int NrZipArchive::entryCount() const
+{
+    return d->names.size();
+}
+
+
+/*!
+ * \brief NrZipArchive::entryNames
+ * \return the stored entry names, in central-directory order
+ */
+QStringList NrZipArchive::entryNames() const
+{
+    return d->names;
+}
+
+
+/*!
+ * \brief NrZipArchive::contains
+ * \param entryName the stored entry name to look up
+ * \return true if the archive holds an entry with that exact name (one hash lookup)
+ */
+bool NrZipArchive::contains(const QString &entryName) const
+{
+    return d->index.contains(entryName);
+}
+
+
+/*!
+ * \brief NrZipArchive::entrySize
+ * \param entryName the stored entry name to look up
+ * \return the uncompressed size of the entry, or -1 when it does not exist
+ */
+qint64 NrZipArchive::entrySize(const QString &entryName) const
+{
+    QHash<QString, NrZipIndexEntry>::const_iterator it = d->index.constFind(entryName);
+    if (it == d->index.constEnd()) {
+        return -1;
+    }
+    return (qint64)it.value().uncompSize;
+}
+
+
+/*!
+ * \brief NrZipArchive::extractEntry extracts one entry into a directory
+ * \param entryName the stored entry name
+ * \param destDir the destination directory (the bare filename of the entry is used)
+ * \return 0 if successful, a negative error code otherwise (E_FILE_NOT_OPEN when the entry does not exist)
+ */
+int NrZipArchive::extractEntry(const QString &entryName, const QString &destDir)
+{
+    QHash<QString, NrZipIndexEntry>::const_iterator it = d->index.constFind(entryName);
+    if (!d->opened || it == d->index.constEnd()) {
+        return NrFileCompressor::E_FILE_NOT_OPEN;
+    }
+    if (!d->ensureReader()) {
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    QString destfn = QFileInfo(entryName).fileName();
+    QString destfilename = QString("%1/%2").arg(!destDir.isEmpty() ? destDir : ".", destfn);
+
+    if (!mz_zip_reader_extract_to_file(&d->zip, it.value().index, destfilename.toLatin1().constData(), 0)) {
+        std::cerr << "Error while extracting file from zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&d->zip)) << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+    return 0;
+}
+
+
+/*!
+ * \brief NrZipArchive::extractEntryToBuffer extracts one entry straight into memory
+ * \param entryName the stored entry name
+ * \param out the QByteArray that will receive the decompressed entry (its previous content is discarded)
+ * \return 0 if successful, a negative error code otherwise (E_FILE_NOT_OPEN when the entry does not exist)
+ */
+int NrZipArchive::extractEntryToBuffer(const QString &entryName, QByteArray &out)
+{
+    QHash<QString, NrZipIndexEntry>::const_iterator it = d->index.constFind(entryName);
+    if (!d->opened || it == d->index.constEnd()) {
+        return NrFileCompressor::E_FILE_NOT_OPEN;
+    }
+    if (!d->ensureReader()) {
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    size_t uncompSize = 0;
+    void *pData = mz_zip_reader_extract_to_heap(&d->zip, it.value().index, &uncompSize, 0);
+    if (!pData) {
+        std::cerr << "Error while extracting file from zip archive: " << mz_zip_get_error_string(mz_zip_get_last_error(&d->zip)) << std::endl;
+        return NrFileCompressor::E_MINIZ_ERROR;
+    }
+
+    out = QByteArray(static_cast<const char *>(pData), (int)uncompSize);
+    mz_free(pData);
+    return 0;
+}
+
+
+END_NRFILECOMPRESSOR_NAMESPACE
@@ -0,0 +1,66 @@
+/********************************************************************************
+ *   Copyright (C) 2018 by NetResults S.r.l. ( http://www.netresults.it )       *
+ *   Author(s):                                                                 *
+ *              Francesco Lamonica  <f.lamonica@netresults.it>                  *
+ ********************************************************************************/
+
+#ifndef NRZIPARCHIVE_H
+#define NRZIPARCHIVE_H
+
+#include "NrFileCompressor.h"
+
+#include <QString>
+#include <QStringList>
+
+BEGIN_NRFILECOMPRESSOR_NAMESPACE
+
+struct NrZipArchivePrivate;
+
+/*!
+ * \brief The NrZipArchive class is a long-lived handle on a zip archive that
+ *        parses the central directory once and serves every later lookup
+ *        from a name-to-entry hash.
+ *
+ * The one-shot NrFileCompressor::uncompressZip*() calls re-read and re-parse
+ * the whole central directory on every invocation - seconds of work on a
+ * 100k-entry bundle. Open an NrZipArchive once instead and repeated
+ * stat/extract calls on the same (immutable) archive cost a hash lookup
+ * plus the inflate of the requested entry.
+ *
+ * A parsed index can also be serialized next to the archive
+ * (saveIndex()/open() with a sidecar path): a later open validates the
+ * sidecar against the archive's size and mtime and, when it matches, skips
+ * the central-directory parse entirely - the miniz reader is then only
+ * initialized lazily, on the first actual extraction.
+ */
+class NrZipArchive
+{
+public:
+    explicit NrZipArchive(const QString &archivePath);
+    ~NrZipArchive();
+
+    bool open();
+    bool open(const QString &sidecarIndexPath);
+    void close();
+
+    bool saveIndex(const QString &sidecarIndexPath) const;
+
+    int entryCount() const;
+    QStringList entryNames() const;
+    bool contains(const QString &entryName) const;
+    qint64 entrySize(const QString &entryName) const;
+
+    int extractEntry(const QString &entryName, const QString &destDir);
+    int extractEntryToBuffer(const QString &entryName, QByteArray &out);
+
+private:
+    /* the handle owns a live miniz reader: copying it makes no sense */
+    NrZipArchive(const NrZipArchive &other);
+    NrZipArchive& operator=(const NrZipArchive &other);
+
+    NrZipArchivePrivate *d;
+};
+
+END_NRFILECOMPRESSOR_NAMESPACE
+
+#endif // NRZIPARCHIVE_H
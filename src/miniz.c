@@ -64,6 +64,19 @@ mz_ulong mz_adler32(mz_ulong adler, const unsigned char *ptr, size_t buf_len)
     return (s2 << 16) + s1;
 }
 
+#ifdef MINIZ_USE_NR_CRC32
+/* Route every CRC through the hardware accelerated kernel in nr_crc32.c
+   (PCLMULQDQ on x86, the crc extension on ARMv8, slice-by-8 otherwise). */
+#include "nr_crc32.h"
+mz_ulong mz_crc32(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len)
+{
+    if (!ptr)
+        return MZ_CRC32_INIT;
+    return (mz_ulong)nr_crc32((unsigned int)crc, ptr, buf_len);
+}
+#define MINIZ_MZ_CRC32_DEFINED
+#endif
+
 /* Karl Malbrain's compact CRC-32. See "A compact CCITT crc16 and crc32 C implementation that balances processor cache usage against speed": http://www.geocities.com/malbrain/ */
 #if 0
     mz_ulong mz_crc32(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len)
@@ -82,7 +95,7 @@ mz_ulong mz_adler32(mz_ulong adler, const unsigned char *ptr, size_t buf_len)
         }
         return ~crcu32;
     }
-#else
+#elif !defined(MINIZ_MZ_CRC32_DEFINED)
 /* Faster, but larger CPU cache footprint.
  */
 mz_ulong mz_crc32(mz_ulong crc, const mz_uint8 *ptr, size_t buf_len)
@@ -230,6 +243,15 @@ int mz_deflateReset(mz_streamp pStream)
     return MZ_OK;
 }
 
+int mz_deflateSetDictionary(mz_streamp pStream, const unsigned char *pDict, unsigned int dict_len)
+{
+    if ((!pStream) || (!pStream->state))
+        return MZ_STREAM_ERROR;
+    if (!tdefl_set_dictionary((tdefl_compressor *)pStream->state, pDict, dict_len))
+        return MZ_STREAM_ERROR;
+    return MZ_OK;
+}
+
 int mz_deflate(mz_streamp pStream, int flush)
 {
     size_t in_bytes, out_bytes;
@@ -1948,6 +1970,48 @@ tdefl_status tdefl_get_prev_return_status(tdefl_compressor *d)
     return d->m_prev_return_status;
 }
 
+mz_bool tdefl_set_dictionary(tdefl_compressor *d, const void *pDict, size_t dict_len)
+{
+    const mz_uint8 *p = (const mz_uint8 *)pDict;
+    mz_uint i, n;
+
+    /* Only allowed on a freshly initialized/reset compressor, before any input. */
+    if ((!d) || (d->m_lookahead_pos) || (d->m_lookahead_size) || (d->m_dict_size) || (d->m_total_lz_bytes))
+        return MZ_FALSE;
+    if ((!p) && (dict_len))
+        return MZ_FALSE;
+
+    /* Only the most recent TDEFL_LZ_DICT_SIZE bytes are reachable by a match anyway. */
+    if (dict_len > TDEFL_LZ_DICT_SIZE)
+    {
+        p += dict_len - TDEFL_LZ_DICT_SIZE;
+        dict_len = TDEFL_LZ_DICT_SIZE;
+    }
+    n = (mz_uint)dict_len;
+    if (!n)
+        return MZ_TRUE;
+
+    memcpy(d->m_dict, p, n);
+    /* keep the wraparound mirror at the end of m_dict coherent */
+    for (i = 0; i < MZ_MIN(n, (mz_uint)(TDEFL_MAX_MATCH_LEN - 1)); i++)
+        d->m_dict[TDEFL_LZ_DICT_SIZE + i] = d->m_dict[i];
+
+    /* Insert every dictionary trigram into the hash chains, using the same hash
+       as the normal compressor path. tdefl_compress_fast() (level 1) hashes
+       differently, so it simply won't find dictionary matches; probes always
+       verify the actual bytes, so mixed chains never produce wrong output. */
+    for (i = 0; i + 2 < n; i++)
+    {
+        mz_uint hash = ((d->m_dict[i] << (TDEFL_LZ_HASH_SHIFT * 2)) ^ (d->m_dict[i + 1] << TDEFL_LZ_HASH_SHIFT) ^ d->m_dict[i + 2]) & (TDEFL_LZ_HASH_SIZE - 1);
+        d->m_next[i] = d->m_hash[hash];
+        d->m_hash[hash] = (mz_uint16)i;
+    }
+
+    d->m_lookahead_pos = n;
+    d->m_dict_size = n;
+    return MZ_TRUE;
+}
+
 mz_uint32 tdefl_get_adler32(tdefl_compressor *d)
 {
     return d->m_adler32;
@@ -321,6 +321,10 @@ int mz_deflateInit2(mz_streamp pStream, int level, int method, int window_bits,
 /* Quickly resets a compressor without having to reallocate anything. Same as calling mz_deflateEnd() followed by mz_deflateInit()/mz_deflateInit2(). */
 int mz_deflateReset(mz_streamp pStream);
 
+/* Primes the deflate stream with a preset dictionary (zlib's deflateSetDictionary()).
+   Call right after mz_deflateInit()/mz_deflateReset(), before compressing any data. */
+int mz_deflateSetDictionary(mz_streamp pStream, const unsigned char *pDict, unsigned int dict_len);
+
 /* mz_deflate() compresses the input to output, consuming as much of the input and producing as much output as possible. */
 /* Parameters: */
 /*   pStream is the stream to read from and write to. You must initialize/update the next_in, avail_in, next_out, and avail_out members. */
@@ -725,6 +729,10 @@ tdefl_status tdefl_compress(tdefl_compressor *d, const void *pIn_buf, size_t *pI
 tdefl_status tdefl_compress_buffer(tdefl_compressor *d, const void *pIn_buf, size_t in_buf_size, tdefl_flush flush);
 
 tdefl_status tdefl_get_prev_return_status(tdefl_compressor *d);
+
+/* Primes a freshly initialized (or reset) compressor with a preset dictionary, like zlib's deflateSetDictionary().
+   Must be called before any input is compressed; the last TDEFL_LZ_DICT_SIZE bytes of the dictionary are used. */
+mz_bool tdefl_set_dictionary(tdefl_compressor *d, const void *pDict, size_t dict_len);
 mz_uint32 tdefl_get_adler32(tdefl_compressor *d);
 
 /* Create tdefl_compress() flags given zlib-style compression parameters. */
@@ -1,11 +1,42 @@
 INCLUDEPATH += $$PWD
 
+# route miniz's CRC-32 (and thus the gzip/zip checksums) through the
+# hardware accelerated kernel in nr_crc32.c
+DEFINES += MINIZ_USE_NR_CRC32
+
 
 SOURCES += \
     $$PWD/miniz.c \
-    $$PWD/NrFileCompressor.cpp
+    $$PWD/nr_crc32.c \
+    $$PWD/NrFileCompressor.cpp \
+    $$PWD/NrCompressionJob.cpp \
+    $$PWD/NrGzipReader.cpp \
+    $$PWD/NrGzipStreamWriter.cpp
 
 
 HEADERS += \
     $$PWD/miniz.h \
-    $$PWD/NrFileCompressor.h
+    $$PWD/nr_crc32.h \
+    $$PWD/NrFileCompressor.h \
+    $$PWD/NrCompressionJob.h \
+    $$PWD/NrGzipReader.h \
+    $$PWD/NrGzipStreamWriter.h
+
+
+# Build-time codec gating, for services that only ever gzip and should
+# not carry miniz's ~7500 lines of zip reader/writer in their .text:
+#
+#   CONFIG += nrfilecompressor_gzip_only    compiles out every zip path
+#                                           (reader, writer, NrZipArchive)
+#   CONFIG += nrfilecompressor_no_zip_writer keeps extraction but drops
+#                                           the archive writer
+nrfilecompressor_gzip_only {
+    DEFINES += NRFILECOMPRESSOR_NO_ZIP MINIZ_NO_ARCHIVE_APIS
+} else {
+    SOURCES += $$PWD/NrZipArchive.cpp
+    HEADERS += $$PWD/NrZipArchive.h
+
+    nrfilecompressor_no_zip_writer {
+        DEFINES += NRFILECOMPRESSOR_NO_ZIP_WRITER MINIZ_NO_ARCHIVE_WRITING_APIS
+    }
+}
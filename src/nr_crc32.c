@@ -0,0 +1,298 @@
+/********************************************************************************
+ *   Copyright (C) 2018 by NetResults S.r.l. ( http://www.netresults.it )       *
+ *   Author(s):                                                                 *
+ *              Francesco Lamonica  <f.lamonica@netresults.it>                  *
+ ********************************************************************************/
+
+#include "nr_crc32.h"
+
+#include <stdint.h>
+
+/* ------------------------------------------------------------------ */
+/* slice-by-8 software kernel (portable fallback)                     */
+/* ------------------------------------------------------------------ */
+
+static uint32_t s_crc_tab[8][256];
+static volatile int s_crc_tab_ready = 0;
+
+static void nr_crc32_init_tables(void)
+{
+    uint32_t i, j, c;
+
+    for (i = 0; i < 256; i++) {
+        c = i;
+        for (j = 0; j < 8; j++) {
+            c = (c & 1) ? (c >> 1) ^ 0xEDB88320u : (c >> 1);
+        }
+        s_crc_tab[0][i] = c;
+    }
+    for (i = 0; i < 256; i++) {
+        c = s_crc_tab[0][i];
+        for (j = 1; j < 8; j++) {
+            c = s_crc_tab[0][c & 0xFF] ^ (c >> 8);
+            s_crc_tab[j][i] = c;
+        }
+    }
+
+    s_crc_tab_ready = 1;
+}
+
+static uint32_t nr_crc32_sw(uint32_t crc, const unsigned char *buf, size_t len)
+{
+    uint32_t c = ~crc;
+
+    if (!s_crc_tab_ready) {
+        nr_crc32_init_tables(); /* idempotent, so a benign race only recomputes */
+    }
+
+    /* align to 8 bytes */
+    while (len && ((uintptr_t)buf & 7)) {
+        c = s_crc_tab[0][(c ^ *buf++) & 0xFF] ^ (c >> 8);
+        len--;
+    }
+
+    while (len >= 8) {
+        uint32_t lo, hi;
+        lo = c ^ ((uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24));
+        hi = (uint32_t)buf[4] | ((uint32_t)buf[5] << 8) | ((uint32_t)buf[6] << 16) | ((uint32_t)buf[7] << 24);
+        c = s_crc_tab[7][lo & 0xFF] ^
+            s_crc_tab[6][(lo >> 8) & 0xFF] ^
+            s_crc_tab[5][(lo >> 16) & 0xFF] ^
+            s_crc_tab[4][(lo >> 24) & 0xFF] ^
+            s_crc_tab[3][hi & 0xFF] ^
+            s_crc_tab[2][(hi >> 8) & 0xFF] ^
+            s_crc_tab[1][(hi >> 16) & 0xFF] ^
+            s_crc_tab[0][(hi >> 24) & 0xFF];
+        buf += 8;
+        len -= 8;
+    }
+
+    while (len--) {
+        c = s_crc_tab[0][(c ^ *buf++) & 0xFF] ^ (c >> 8);
+    }
+
+    return ~c;
+}
+
+/* ------------------------------------------------------------------ */
+/* x86 / x86-64 PCLMULQDQ folding kernel                              */
+/* ------------------------------------------------------------------ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define NR_CRC32_HAVE_PCLMUL 1
+
+#include <immintrin.h>
+
+/*
+ * Folding constants for the 0xEDB88320 polynomial, from "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+ * (Intel white paper); same values used by zlib's SIMD kernel.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t nr_crc32_pclmul(uint32_t crc, const unsigned char *buf, size_t len)
+{
+    const __m128i k1k2 = _mm_set_epi64x(0x00000001c6e41596LL, 0x0000000154442bd4LL);
+    const __m128i k3k4 = _mm_set_epi64x(0x00000000ccaa009eLL, 0x00000001751997d0LL);
+    const __m128i k5   = _mm_set_epi64x(0x0000000000000000LL, 0x0000000163cd6124LL);
+    const __m128i poly = _mm_set_epi64x(0x00000001f7011641LL, 0x00000001db710641LL);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    /* the caller guarantees len >= 64 and handles the tail in software */
+    x1 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+
+    buf += 64;
+    len -= 64;
+
+    /* fold 64 bytes per iteration */
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(const void *)(buf + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        buf += 64;
+        len -= 64;
+    }
+
+    /* fold the four lanes into one */
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* fold the remaining 16-byte blocks */
+    while (len >= 16) {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)(const void *)buf));
+        x1 = _mm_xor_si128(x1, x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    /* fold 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x3 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x2, x3);
+
+    /* fold 64 bits to 32 bits */
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction */
+    x2 = _mm_and_si128(x1, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static int nr_crc32_pclmul_supported(void)
+{
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+
+#endif /* x86 */
+
+/* ------------------------------------------------------------------ */
+/* ARMv8 crc extension kernel                                         */
+/* ------------------------------------------------------------------ */
+
+#if defined(__aarch64__) && defined(__GNUC__) && defined(__linux__)
+#define NR_CRC32_HAVE_ARMV8 1
+
+#include <arm_acle.h>
+#include <sys/auxv.h>
+
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+
+__attribute__((target("+crc")))
+static uint32_t nr_crc32_armv8(uint32_t crc, const unsigned char *buf, size_t len)
+{
+    uint32_t c = ~crc;
+
+    while (len && ((uintptr_t)buf & 7)) {
+        c = __crc32b(c, *buf++);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t v;
+        __builtin_memcpy(&v, buf, 8);
+        c = __crc32d(c, v);
+        buf += 8;
+        len -= 8;
+    }
+    while (len--) {
+        c = __crc32b(c, *buf++);
+    }
+
+    return ~c;
+}
+
+static int nr_crc32_armv8_supported(void)
+{
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+#endif /* aarch64 */
+
+/* ------------------------------------------------------------------ */
+/* runtime dispatch                                                   */
+/* ------------------------------------------------------------------ */
+
+enum {
+    NR_CRC32_IMPL_UNDECIDED = 0,
+    NR_CRC32_IMPL_SW,
+    NR_CRC32_IMPL_PCLMUL,
+    NR_CRC32_IMPL_ARMV8
+};
+
+static volatile int s_crc_impl = NR_CRC32_IMPL_UNDECIDED;
+
+static int nr_crc32_pick_impl(void)
+{
+    int impl = NR_CRC32_IMPL_SW;
+
+#ifdef NR_CRC32_HAVE_PCLMUL
+    if (nr_crc32_pclmul_supported()) {
+        impl = NR_CRC32_IMPL_PCLMUL;
+    }
+#endif
+#ifdef NR_CRC32_HAVE_ARMV8
+    if (nr_crc32_armv8_supported()) {
+        impl = NR_CRC32_IMPL_ARMV8;
+    }
+#endif
+
+    s_crc_impl = impl;
+    return impl;
+}
+
+unsigned int nr_crc32(unsigned int crc, const unsigned char *buf, size_t len)
+{
+    int impl = s_crc_impl;
+
+    if (!buf || !len) {
+        return crc; /* mz_crc32()-compatible: a NULL/empty update is a no-op */
+    }
+
+    if (impl == NR_CRC32_IMPL_UNDECIDED) {
+        impl = nr_crc32_pick_impl();
+    }
+
+#ifdef NR_CRC32_HAVE_PCLMUL
+    /* the folding kernel wants at least 64 bytes, in 16-byte units;
+       the tail is mopped up by the software kernel */
+    if (impl == NR_CRC32_IMPL_PCLMUL && len >= 64) {
+        size_t simd_len = len & ~(size_t)15;
+        uint32_t c = nr_crc32_pclmul(~(uint32_t)crc, buf, simd_len); /* works on the inverted state */
+        c = ~c;
+        if (len - simd_len) {
+            c = nr_crc32_sw(c, buf + simd_len, len - simd_len);
+        }
+        return c;
+    }
+#endif
+#ifdef NR_CRC32_HAVE_ARMV8
+    if (impl == NR_CRC32_IMPL_ARMV8) {
+        return nr_crc32_armv8((uint32_t)crc, buf, len);
+    }
+#endif
+
+    return nr_crc32_sw((uint32_t)crc, buf, len);
+}
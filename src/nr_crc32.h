@@ -0,0 +1,34 @@
+/********************************************************************************
+ *   Copyright (C) 2018 by NetResults S.r.l. ( http://www.netresults.it )       *
+ *   Author(s):                                                                 *
+ *              Francesco Lamonica  <f.lamonica@netresults.it>                  *
+ ********************************************************************************/
+
+#ifndef NR_CRC32_H
+#define NR_CRC32_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Hardware accelerated CRC-32 (the zlib/gzip polynomial, 0xEDB88320).
+ *
+ * The best kernel for the running CPU is picked once at first call:
+ *  - x86/x86-64: PCLMULQDQ carry-less multiplication folding
+ *  - ARMv8:      the CRC32 instructions of the crc extension
+ *  - otherwise:  a slice-by-8 table implementation (still several times
+ *                faster than miniz's 4-bit table loop)
+ *
+ * Drop-in compatible with mz_crc32()/crc32(): pass 0 (or the value of a
+ * previous call) as crc and feed the data in any chunking.
+ */
+unsigned int nr_crc32(unsigned int crc, const unsigned char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NR_CRC32_H */